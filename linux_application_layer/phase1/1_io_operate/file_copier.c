@@ -1,21 +1,1397 @@
 /****** 文本复制器 ******/
+#define _GNU_SOURCE     // copy_file_range、splice、SEEK_DATA / SEEK_HOLE
 #include <stdio.h>      // 标准输入输出库
 #include <stdlib.h>     // 提供 EXIT_SUCCESS 和 EXIT_FAILURE
+#include <errno.h>      // errno 及错误码
 #include <fcntl.h>      // 文件控制选项（如 O_RDONLY, O_WRONLY, O_CREAT, O_TRUNC）
 #include <unistd.h>     // 提供 `read`, `write`, `close` 等系统调用
+#include <string.h>     // strerror
+#include <pthread.h>    // -j 并行复制的工作线程
+#include <stdatomic.h>  // 分块计数与失败标志
+#include <dirent.h>     // -r 遍历目录
+#include <limits.h>     // PATH_MAX
+#include <stdint.h>     // uint32_t
+#include <time.h>       // clock_gettime，进度与吞吐量
+#include <sys/ioctl.h>  // ioctl(FICLONE)
+#include <sys/stat.h>   // fstat，判断文件类型
+#include <sys/sendfile.h>   // sendfile
+#include <linux/fs.h>   // FICLONE
+#if defined(__x86_64__)
+#include <nmmintrin.h>  // SSE4.2 crc32 指令
+#endif
 
-#define BUFFER_SIZE 1024  // 定义缓冲区大小，每次读取 1024 字节，提高效率
+#define BUFFER_SIZE (1024 * 1024)   // 回退到 read/write 时的缓冲区大小（1 MiB），减少系统调用次数
+#define ENGINE_CHUNK (64 * 1024 * 1024) // copy_file_range / sendfile / splice 每次调用最多搬运的字节数
+#define PARALLEL_MAX_THREADS 64             // -j 上限
+#define PARALLEL_MIN_CHUNK (8 * 1024 * 1024)    // 并行复制的最小分块，过小时线程调度开销超过收益
+#define SMALL_FILE_MAX (64 * 1024)          // -r 时不超过该大小的文件一次 read、一次 write 完成
+#define PIPE_SLOTS 8                        // -v 流水线中轮转使用的缓冲区个数（每个 BUFFER_SIZE）
+#define PROGRESS_INTERVAL_MS 250            // 进度行刷新间隔
+#define HOLE_BLOCK_MAX (1024 * 1024 * 1024) // -v 时一个空洞块最多代表的字节数
+
+// 实际使用的复制方式
+typedef enum {
+    COPY_PATH_REFLINK,          // FICLONE 整文件克隆，只共享数据块，不搬运数据
+    COPY_PATH_COPY_FILE_RANGE,  // 内核内复制，文件系统支持时可卸载到存储设备
+    COPY_PATH_SENDFILE,         // 内核内从页缓存直接写到目标
+    COPY_PATH_SPLICE,           // 经由管道在内核内搬运
+    COPY_PATH_READ_WRITE,       // 用户态缓冲区
+    COPY_PATH_PIPELINE,         // -v：读、校验、写三个线程流水线
+} copy_path_t;
+
+static const char *copy_path_name[] = {
+    [COPY_PATH_REFLINK]         = "reflink",
+    [COPY_PATH_COPY_FILE_RANGE] = "copy_file_range",
+    [COPY_PATH_SENDFILE]        = "sendfile",
+    [COPY_PATH_SPLICE]          = "splice",
+    [COPY_PATH_READ_WRITE]      = "read/write",
+    [COPY_PATH_PIPELINE]        = "pipelined read/crc32c/write",
+};
+
+// 复制结果统计
+typedef struct {
+    off_t logical;      // 目标文件的逻辑大小（含空洞）
+    off_t physical;     // 实际搬运的数据字节数（空洞和克隆共享的数据块不计）
+} copy_stats_t;
+
+// 复制引擎返回值
+#define ENGINE_DONE         0   // 已复制到文件末尾
+#define ENGINE_UNSUPPORTED  1   // 当前文件组合不支持，换下一种方式（文件偏移已随已复制的字节推进）
+#define ENGINE_ERROR        -1  // 出错，errno 有效
+
+// 该错误表示“这种方式不适用”，而不是真正的 I/O 错误
+static int is_unsupported(int err)
+{
+    return err == EINVAL || err == ENOSYS || err == EXDEV || err == EOPNOTSUPP ||
+           err == ENOTSUP || err == EBADF || err == ESPIPE;
+}
+
+// 写满 len 字节，处理短写和 EINTR
+static int write_all(int fd, const char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* ---------- 普通文件之间：按偏移复制数据段 ---------- */
+
+// 按偏移复制的共享状态，单线程和 -j 并行复制共用
+typedef struct {
+    int in, out;
+    atomic_int use_pread;       // copy_file_range 不可用后改用 pread/pwrite（所有线程共享）
+    atomic_llong physical;      // 实际搬运的字节数
+    atomic_llong eof;           // 源文件实际结束的位置（比 fstat 报告的小时记录），-1 表示未发生
+} range_copy_t;
+
+#define RANGE_SHORT 1   // 源文件在预期位置之前就结束了
+
+/*
+ * 以显式偏移复制 [off, end)，不改变共享的文件偏移，可被多个线程同时调用。
+ * 优先 copy_file_range，不支持或返回 0 时改用 pread/pwrite（缓冲区按需分配到 *buffer）。
+ * @return 0 成功； RANGE_SHORT 源文件提前结束； -1 出错
+ */
+static int copy_range(range_copy_t *rc, off_t off, off_t end, char **buffer)
+{
+    while (off < end && !atomic_load(&rc->use_pread)) {
+        loff_t in_off = off, out_off = off;
+        ssize_t n = copy_file_range(rc->in, &in_off, rc->out, &out_off, end - off, 0);
+        if (n > 0) {
+            off += n;
+            atomic_fetch_add(&rc->physical, n);
+            continue;
+        }
+        if (n == -1 && errno == EINTR) continue;
+        if (n == -1 && !is_unsupported(errno)) return -1;
+        // 返回 0 或不支持：部分虚拟文件系统上 copy_file_range 读不出数据，剩余部分改用 pread/pwrite
+        atomic_store(&rc->use_pread, 1);
+    }
+
+    if (off < end && *buffer == NULL && (*buffer = malloc(BUFFER_SIZE)) == NULL) return -1;
+    while (off < end) {
+        size_t want = end - off < BUFFER_SIZE ? end - off : BUFFER_SIZE;
+        ssize_t n = pread(rc->in, *buffer, want, off);
+        if (n == -1 && errno == EINTR) continue;
+        if (n == -1) return -1;
+        if (n == 0) {   // 源文件比 fstat 报告的短（被截短或是 sysfs 之类的虚拟文件）
+            atomic_store(&rc->eof, off);
+            return RANGE_SHORT;
+        }
+        for (ssize_t done = 0; done < n; ) {
+            ssize_t m = pwrite(rc->out, *buffer + done, n - done, off + done);
+            if (m == -1 && errno == EINTR) continue;
+            if (m == -1) return -1;
+            done += m;
+        }
+        off += n;
+        atomic_fetch_add(&rc->physical, n);
+    }
+    return 0;
+}
+
+/*
+ * 只复制 [off, end) 中的数据段，SEEK_DATA / SEEK_HOLE 找到的空洞直接跳过，
+ * 目标中对应位置保持为空洞（由最终的文件大小或 ftruncate 补齐）。
+ * 文件系统不支持时把整段当作数据复制。返回值同 copy_range。
+ */
+static int copy_data_segments(range_copy_t *rc, off_t off, off_t end, char **buffer)
+{
+    while (off < end) {
+        // 这里只使用返回值，并发线程改动共享的文件偏移不影响结果
+        off_t data = lseek(rc->in, off, SEEK_DATA);
+        if (data == -1) {
+            if (errno == ENXIO) return 0;   // off 之后全是空洞
+            if (is_unsupported(errno)) return copy_range(rc, off, end, buffer);
+            return -1;
+        }
+        if (data >= end) return 0;
+        off_t hole = lseek(rc->in, data, SEEK_HOLE);
+        if (hole == -1) return -1;
+        if (hole > end) hole = end;
+
+        int ret = copy_range(rc, data, hole, buffer);
+        if (ret != 0) return ret;
+        off = hole;
+    }
+    return 0;
+}
+
+// 整文件克隆：btrfs、XFS 等支持 reflink 的文件系统上几乎瞬间完成
+static int try_reflink(int in, int out)
+{
+    return ioctl(out, FICLONE, in) == 0;
+}
+
+// 普通文件 -> 普通文件：克隆优先，否则按数据段复制，保留空洞
+static int copy_sparse(int in, int out, off_t size, copy_stats_t *stats, copy_path_t *used)
+{
+    range_copy_t rc = { .in = in, .out = out, .eof = -1 };
+    char *buffer = NULL;
+
+    if (try_reflink(in, out)) {
+        *used = COPY_PATH_REFLINK;
+        stats->logical = size;
+        return ENGINE_DONE;
+    }
+
+    int ret = copy_data_segments(&rc, 0, size, &buffer);
+    int saved = errno;
+    free(buffer);
+    stats->physical = atomic_load(&rc.physical);
+    *used = atomic_load(&rc.use_pread) ? COPY_PATH_READ_WRITE : COPY_PATH_COPY_FILE_RANGE;
+    if (ret == -1) {
+        errno = saved;
+        return ENGINE_ERROR;
+    }
+    if (ret == RANGE_SHORT) size = atomic_load(&rc.eof);
+
+    // 末尾的空洞不会被写入，用 ftruncate 把目标补齐到源文件大小
+    if (ftruncate(out, size) == -1) return ENGINE_ERROR;
+    stats->logical = size;
+    return ENGINE_DONE;
+}
+
+/* ---------- 其他文件类型：按文件偏移顺序复制 ---------- */
+
+// 源为普通文件：sendfile，目标可以是文件、管道、终端或套接字
+static int copy_with_sendfile(int in, int out, off_t size, off_t *copied)
+{
+    for (;;) {
+        ssize_t n = sendfile(out, in, NULL, ENGINE_CHUNK);
+        if (n > 0) {
+            *copied += n;
+            continue;
+        }
+        if (n == 0) return *copied >= size ? ENGINE_DONE : ENGINE_UNSUPPORTED;
+        if (errno == EINTR) continue;
+        return is_unsupported(errno) ? ENGINE_UNSUPPORTED : ENGINE_ERROR;
+    }
+}
+
+// 一端是管道时直接 splice；否则经由一个中间管道（源 -> 管道 -> 目标）
+static int copy_with_splice(int in, int out, int in_is_pipe, int out_is_pipe, off_t *copied)
+{
+    if (in_is_pipe || out_is_pipe) {
+        for (;;) {
+            ssize_t n = splice(in, NULL, out, NULL, ENGINE_CHUNK, SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (n > 0) {
+                *copied += n;
+                continue;
+            }
+            if (n == 0) return ENGINE_DONE;
+            if (errno == EINTR) continue;
+            return is_unsupported(errno) ? ENGINE_UNSUPPORTED : ENGINE_ERROR;
+        }
+    }
+
+    int pipefd[2];
+    if (pipe(pipefd) == -1) return ENGINE_UNSUPPORTED;
+    int ret = ENGINE_DONE;
+    for (;;) {
+        ssize_t n = splice(in, NULL, pipefd[1], NULL, ENGINE_CHUNK, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (n == 0) break;
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            ret = is_unsupported(errno) ? ENGINE_UNSUPPORTED : ENGINE_ERROR;
+            break;
+        }
+        // 管道中的数据必须全部写出，否则已从源读出的数据会丢失
+        while (n > 0) {
+            ssize_t m = splice(pipefd[0], NULL, out, NULL, n, SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (m == -1 && errno == EINTR) continue;
+            if (m <= 0) {
+                ret = ENGINE_ERROR;
+                break;
+            }
+            n -= m;
+            *copied += m;
+        }
+        if (ret != ENGINE_DONE) break;
+    }
+    int saved = errno;
+    close(pipefd[0]);
+    close(pipefd[1]);
+    errno = saved;
+    return ret;
+}
+
+// 用户态缓冲区兜底
+static int copy_with_read_write(int in, int out, off_t *copied)
+{
+    char *buffer = malloc(BUFFER_SIZE);    // 大缓冲区放在堆上
+    if (buffer == NULL) return ENGINE_ERROR;
+    int ret = ENGINE_DONE;
+    for (;;) {
+        ssize_t bytes_read = read(in, buffer, BUFFER_SIZE);
+        if (bytes_read == 0) break;
+        if (bytes_read == -1) {
+            if (errno == EINTR) continue;
+            perror("Failed to read from source file");
+            ret = ENGINE_ERROR;
+            break;
+        }
+        if (write_all(out, buffer, bytes_read) == -1) {
+            perror("Failed to write to destination file");
+            ret = ENGINE_ERROR;
+            break;
+        }
+        *copied += bytes_read;
+    }
+    free(buffer);
+    return ret;
+}
+
+/*
+ * 按源和目标的类型依次尝试：
+ *   普通文件 -> 普通文件：FICLONE，否则按数据段 copy_file_range（保留空洞）
+ *   普通文件 -> 任意：    sendfile
+ *   含管道 / 其他：       splice
+ *   兜底：                read/write
+ * 一种方式不适用时换下一种，已复制的部分不会重复（都使用文件偏移推进）。
+ */
+static int copy_fd(int in, int out, copy_stats_t *stats, copy_path_t *used)
+{
+    struct stat in_st, out_st;
+    if (fstat(in, &in_st) == -1 || fstat(out, &out_st) == -1) {
+        perror("fstat");
+        return -1;
+    }
+    // 大小为 0 的普通文件可能是 /proc 之类的虚拟文件，只能 read
+    int in_reg = S_ISREG(in_st.st_mode) && in_st.st_size > 0;
+    int out_reg = S_ISREG(out_st.st_mode);
+    int in_pipe = S_ISFIFO(in_st.st_mode);
+    int out_pipe = S_ISFIFO(out_st.st_mode);
+    int ret = ENGINE_UNSUPPORTED;
+    off_t copied = 0;
+
+    stats->logical = stats->physical = 0;
+    if (in_reg && out_reg) {
+        if (copy_sparse(in, out, in_st.st_size, stats, used) == ENGINE_ERROR) {
+            perror(copy_path_name[*used]);
+            return -1;
+        }
+        return 0;
+    }
+
+    if (in_reg) {
+        *used = COPY_PATH_SENDFILE;
+        ret = copy_with_sendfile(in, out, in_st.st_size, &copied);
+    }
+    if (ret == ENGINE_UNSUPPORTED && !in_reg) {
+        *used = COPY_PATH_SPLICE;
+        ret = copy_with_splice(in, out, in_pipe, out_pipe, &copied);
+    }
+    if (ret == ENGINE_UNSUPPORTED) {
+        *used = COPY_PATH_READ_WRITE;
+        ret = copy_with_read_write(in, out, &copied);
+    }
+    stats->logical = stats->physical = copied;
+    if (ret == ENGINE_ERROR) {
+        if (*used != COPY_PATH_READ_WRITE) perror(copy_path_name[*used]);
+        return -1;
+    }
+    return 0;
+}
+
+/* ---------- -j N 并行分块复制 ---------- */
+
+// 所有工作线程共享的任务描述
+typedef struct {
+    range_copy_t rc;
+    off_t size;                 // 源文件大小
+    off_t chunk;                // 分块大小
+    atomic_llong next_chunk;    // 下一个待领取的分块序号
+    atomic_int failed;          // 任一分块失败后其他线程不再领取新分块
+    int err;                    // 第一个失败的 errno
+    pthread_mutex_t lock;       // 保护 err
+} parallel_job_t;
+
+static void parallel_fail(parallel_job_t *job, int err)
+{
+    pthread_mutex_lock(&job->lock);
+    if (!atomic_load(&job->failed)) {
+        job->err = err;
+        atomic_store(&job->failed, 1);
+    }
+    pthread_mutex_unlock(&job->lock);
+}
+
+static void *parallel_worker(void *arg)
+{
+    parallel_job_t *job = arg;
+    char *buffer = NULL;    // 仅在回退到 pread/pwrite 时分配
+
+    while (!atomic_load(&job->failed)) {
+        off_t off = (off_t)atomic_fetch_add(&job->next_chunk, 1) * job->chunk;
+        if (off >= job->size) break;
+        off_t len = job->size - off < job->chunk ? job->size - off : job->chunk;
+
+        int ret = copy_data_segments(&job->rc, off, off + len, &buffer);
+        if (ret != 0) {
+            // 并行复制时源文件被截短按错误处理，已预分配的目标无法可靠收缩
+            parallel_fail(job, ret == RANGE_SHORT ? EIO : errno);
+            break;
+        }
+        // 已复制的分块不会再被读写：先把目标写回磁盘，再让内核丢弃两端的页缓存
+        sync_file_range(job->rc.out, off, len,
+                        SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        posix_fadvise(job->rc.out, off, len, POSIX_FADV_DONTNEED);
+        posix_fadvise(job->rc.in, off, len, POSIX_FADV_DONTNEED);
+    }
+    free(buffer);
+    return NULL;
+}
+
+/*
+ * 用 threads 个线程分块复制普通文件。
+ * 能克隆时直接克隆；否则目标先设置到完整大小（非稀疏文件用 fallocate 预分配），
+ * 各线程按偏移独立复制各自分块中的数据段，互不竞争文件偏移。
+ * 失败时等待所有线程退出后返回 -1，errno 为第一个失败分块的错误。
+ */
+static int copy_parallel(int in, int out, const struct stat *in_st, int threads,
+                         copy_stats_t *stats, copy_path_t *used)
+{
+    parallel_job_t job = { .rc = { .in = in, .out = out, .eof = -1 }, .size = in_st->st_size };
+    pthread_t tids[PARALLEL_MAX_THREADS];
+    int started = 0;
+
+    stats->logical = in_st->st_size;
+    stats->physical = 0;
+    if (try_reflink(in, out)) {
+        *used = COPY_PATH_REFLINK;
+        return 0;
+    }
+
+    // 分块数取线程数的 4 倍，让先完成的线程继续领取，平衡不同位置的读写速度
+    job.chunk = job.size / ((off_t)threads * 4);
+    if (job.chunk < PARALLEL_MIN_CHUNK) job.chunk = PARALLEL_MIN_CHUNK;
+    job.chunk = (job.chunk + BUFFER_SIZE - 1) / BUFFER_SIZE * BUFFER_SIZE;
+
+    // 预分配避免并发写入时频繁扩展文件和产生碎片；源文件有空洞时只设置大小，保持稀疏
+    int sparse = (off_t)in_st->st_blocks * 512 < job.size;
+    if ((sparse || fallocate(out, 0, 0, job.size) == -1) && ftruncate(out, job.size) == -1) {
+        perror("Failed to preallocate destination file");
+        return -1;
+    }
+    posix_fadvise(in, 0, job.size, POSIX_FADV_SEQUENTIAL);
+
+    pthread_mutex_init(&job.lock, NULL);
+    for (; started < threads; started++) {
+        int err = pthread_create(&tids[started], NULL, parallel_worker, &job);
+        if (err != 0) {
+            parallel_fail(&job, err);
+            break;
+        }
+    }
+    for (int i = 0; i < started; i++)
+        pthread_join(tids[i], NULL);
+    pthread_mutex_destroy(&job.lock);
+
+    stats->physical = atomic_load(&job.rc.physical);
+    *used = atomic_load(&job.rc.use_pread) ? COPY_PATH_READ_WRITE : COPY_PATH_COPY_FILE_RANGE;
+    if (atomic_load(&job.failed)) {
+        fprintf(stderr, "Parallel copy failed: %s\n", strerror(job.err));
+        errno = job.err;
+        return -1;
+    }
+    return 0;
+}
+
+/* ---------- -r 递归复制目录树（工作窃取线程池） ---------- */
+
+typedef enum {
+    TASK_DIR,       // 创建目标目录并把目录项拆成子任务
+    TASK_FILE,      // 复制普通文件
+    TASK_SYMLINK,   // 重建符号链接（不跟随）
+    TASK_FIFO,      // 重建命名管道
+} tree_task_type_t;
+
+typedef struct {
+    tree_task_type_t type;
+    char *src;
+    char *dst;
+    char paths[];   // src 与 dst 两个字符串紧跟在结构体后，一次分配
+} tree_task_t;
+
+struct tree_copy;
+
+/*
+ * 每个工作线程一个双端队列：自己从尾部压入和弹出（后进先出，刚展开的目录项仍在缓存中），
+ * 空闲线程从其他队列的头部窃取（先进先出，偷走的往往是较大的子树）。
+ */
+typedef struct {
+    struct tree_copy *tc;
+    tree_task_t **items;    // 环形数组，容量为 2 的幂
+    size_t cap, head, count;
+    pthread_mutex_t lock;
+    char *small_buf;        // 小文件快速路径的缓冲区
+    unsigned seed;          // 随机选择窃取对象
+} tree_worker_t;
+
+// 目录的权限和时间戳要在其内容复制完后再设置，否则会被新建的子项改掉
+typedef struct {
+    char *dst;
+    mode_t mode;
+    struct timespec times[2];
+} tree_dir_meta_t;
+
+typedef struct tree_copy {
+    tree_worker_t *workers;
+    int nworkers;
+    int preserve;               // -p：保留权限和时间戳
+    mode_t umask;
+    dev_t dst_dev;              // 目标根目录，遍历时跳过它，避免复制到自身内部时无限递归
+    ino_t dst_ino;
+
+    atomic_long pending;        // 已创建但尚未完成的任务数，降为 0 时全部完成
+    atomic_uint work_seq;       // 每压入一个任务加 1，空闲线程据此判断是否有新任务
+    atomic_int sleepers;        // 正在等待任务的线程数
+    pthread_mutex_t idle_lock;
+    pthread_cond_t idle_cond;
+
+    tree_dir_meta_t *dirs;      // 按创建顺序记录，父目录总在子目录之前
+    size_t dir_count, dir_cap;
+    pthread_mutex_t dirs_lock;
+
+    atomic_long files, directories, symlinks, fifos, errors;
+    atomic_llong logical, physical;
+} tree_copy_t;
+
+static void tree_error(tree_copy_t *tc, const char *what, const char *path)
+{
+    fprintf(stderr, "%s %s: %s\n", what, path, strerror(errno));
+    atomic_fetch_add(&tc->errors, 1);
+}
+
+static int deque_push(tree_worker_t *w, tree_task_t *task)
+{
+    pthread_mutex_lock(&w->lock);
+    if (w->count == w->cap) {
+        size_t cap = w->cap ? w->cap * 2 : 64;
+        tree_task_t **items = malloc(cap * sizeof(*items));
+        if (items == NULL) {
+            pthread_mutex_unlock(&w->lock);
+            return -1;
+        }
+        for (size_t i = 0; i < w->count; i++)
+            items[i] = w->items[(w->head + i) & (w->cap - 1)];
+        free(w->items);
+        w->items = items;
+        w->cap = cap;
+        w->head = 0;
+    }
+    w->items[(w->head + w->count++) & (w->cap - 1)] = task;
+    pthread_mutex_unlock(&w->lock);
+    return 0;
+}
+
+static tree_task_t *deque_pop(tree_worker_t *w)
+{
+    tree_task_t *task = NULL;
+    pthread_mutex_lock(&w->lock);
+    if (w->count > 0)
+        task = w->items[(w->head + --w->count) & (w->cap - 1)];
+    pthread_mutex_unlock(&w->lock);
+    return task;
+}
+
+static tree_task_t *deque_steal(tree_worker_t *w)
+{
+    tree_task_t *task = NULL;
+    pthread_mutex_lock(&w->lock);
+    if (w->count > 0) {
+        task = w->items[w->head];
+        w->head = (w->head + 1) & (w->cap - 1);
+        w->count--;
+    }
+    pthread_mutex_unlock(&w->lock);
+    return task;
+}
+
+// 创建任务并压入 w 的队列；有线程在等待时唤醒一个
+static void tree_push(tree_copy_t *tc, tree_worker_t *w, tree_task_type_t type,
+                      const char *src_dir, const char *dst_dir, const char *name)
+{
+    size_t src_len = strlen(src_dir) + (name ? strlen(name) + 1 : 0) + 1;
+    size_t dst_len = strlen(dst_dir) + (name ? strlen(name) + 1 : 0) + 1;
+    tree_task_t *task = malloc(sizeof(*task) + src_len + dst_len);
+    if (task == NULL) {
+        tree_error(tc, "Failed to queue", src_dir);
+        return;
+    }
+    task->type = type;
+    task->src = task->paths;
+    task->dst = task->paths + src_len;
+    snprintf(task->src, src_len, name ? "%s/%s" : "%s", src_dir, name);
+    snprintf(task->dst, dst_len, name ? "%s/%s" : "%s", dst_dir, name);
+
+    atomic_fetch_add(&tc->pending, 1);
+    if (deque_push(w, task) == -1) {
+        tree_error(tc, "Failed to queue", task->src);
+        free(task);
+        atomic_fetch_sub(&tc->pending, 1);
+        return;
+    }
+    atomic_fetch_add(&tc->work_seq, 1);
+    if (atomic_load(&tc->sleepers) > 0) {
+        pthread_mutex_lock(&tc->idle_lock);
+        pthread_cond_signal(&tc->idle_cond);
+        pthread_mutex_unlock(&tc->idle_lock);
+    }
+}
+
+/*
+ * 以可写权限创建目标目录。已存在的目录直接使用；同名的符号链接或文件先删除再创建，
+ * 以免跟随链接写到目录树之外（根目录由 copy_tree 检查过，允许是指向目录的链接）。
+ */
+static int tree_mkdir(tree_copy_t *tc, const char *path)
+{
+    struct stat st;
+    if (mkdir(path, 0700) == 0) return 0;
+    if (errno != EEXIST || lstat(path, &st) == -1) return -1;
+    if (S_ISDIR(st.st_mode)) return 0;
+    if (S_ISLNK(st.st_mode) && stat(path, &st) == 0 && st.st_dev == tc->dst_dev && st.st_ino == tc->dst_ino)
+        return 0;
+    if (unlink(path) == -1) return -1;
+    return mkdir(path, 0700);
+}
+
+static void tree_copy_dir(tree_copy_t *tc, tree_worker_t *w, tree_task_t *task)
+{
+    DIR *dir = opendir(task->src);
+    if (dir == NULL) {
+        tree_error(tc, "Failed to open directory", task->src);
+        return;
+    }
+    struct stat st;
+    if (fstat(dirfd(dir), &st) == -1) {
+        tree_error(tc, "Failed to stat", task->src);
+        closedir(dir);
+        return;
+    }
+    if (st.st_dev == tc->dst_dev && st.st_ino == tc->dst_ino) {    // 目标位于源目录树内部
+        closedir(dir);
+        return;
+    }
+
+    // 先以可写权限创建，内容复制完后再设置为最终权限（源目录可能是只读的）
+    if (tree_mkdir(tc, task->dst) == -1) {
+        tree_error(tc, "Failed to create directory", task->dst);
+        closedir(dir);
+        return;
+    }
+    pthread_mutex_lock(&tc->dirs_lock);
+    if (tc->dir_count == tc->dir_cap) {
+        size_t cap = tc->dir_cap ? tc->dir_cap * 2 : 64;
+        tree_dir_meta_t *dirs = realloc(tc->dirs, cap * sizeof(*dirs));
+        if (dirs != NULL) {
+            tc->dirs = dirs;
+            tc->dir_cap = cap;
+        }
+    }
+    if (tc->dir_count < tc->dir_cap && (tc->dirs[tc->dir_count].dst = strdup(task->dst)) != NULL) {
+        tree_dir_meta_t *meta = &tc->dirs[tc->dir_count++];
+        meta->mode = st.st_mode;
+        meta->times[0] = st.st_atim;
+        meta->times[1] = st.st_mtim;
+    }
+    pthread_mutex_unlock(&tc->dirs_lock);
+    atomic_fetch_add(&tc->directories, 1);
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        const char *name = entry->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+
+        // d_type 省去每个目录项一次 lstat；文件系统不提供时才退回 lstat
+        unsigned char type = entry->d_type;
+        if (type == DT_UNKNOWN) {
+            struct stat est;
+            if (fstatat(dirfd(dir), name, &est, AT_SYMLINK_NOFOLLOW) == -1) {
+                tree_error(tc, "Failed to stat", name);
+                continue;
+            }
+            type = S_ISDIR(est.st_mode) ? DT_DIR : S_ISREG(est.st_mode) ? DT_REG :
+                   S_ISLNK(est.st_mode) ? DT_LNK : S_ISFIFO(est.st_mode) ? DT_FIFO : DT_UNKNOWN;
+        }
+        if (type == DT_DIR) tree_push(tc, w, TASK_DIR, task->src, task->dst, name);
+        else if (type == DT_REG) tree_push(tc, w, TASK_FILE, task->src, task->dst, name);
+        else if (type == DT_LNK) tree_push(tc, w, TASK_SYMLINK, task->src, task->dst, name);
+        else if (type == DT_FIFO) tree_push(tc, w, TASK_FIFO, task->src, task->dst, name);
+        else {
+            // 设备节点和套接字不复制，计为错误，使退出状态反映目录树没有完整复制
+            fprintf(stderr, "Skipping special file %s/%s\n", task->src, name);
+            atomic_fetch_add(&tc->errors, 1);
+        }
+    }
+    closedir(dir);
+}
+
+static void tree_copy_file(tree_copy_t *tc, tree_worker_t *w, tree_task_t *task)
+{
+    int in = open(task->src, O_RDONLY | O_NOFOLLOW);
+    if (in == -1) {
+        tree_error(tc, "Failed to open", task->src);
+        return;
+    }
+    struct stat st;
+    if (fstat(in, &st) == -1) {
+        tree_error(tc, "Failed to stat", task->src);
+        close(in);
+        return;
+    }
+    // 目标处已有的符号链接不跟随（可能指向目录树之外），与 tree_copy_symlink 一样先删除再新建
+    int out = open(task->dst, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW, st.st_mode & 0777);
+    if (out == -1 && errno == ELOOP && unlink(task->dst) == 0)
+        out = open(task->dst, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW, st.st_mode & 0777);
+    if (out == -1) {
+        tree_error(tc, "Failed to create", task->dst);
+        close(in);
+        return;
+    }
+
+    int ok;
+    copy_stats_t stats = { 0, 0 };
+    if (st.st_size <= SMALL_FILE_MAX) {
+        // 小文件快速路径：一次 read、一次 write，不做克隆和空洞探测
+        ssize_t n = read(in, w->small_buf, SMALL_FILE_MAX);
+        ok = n >= 0 && write_all(out, w->small_buf, n) == 0;
+        stats.logical = stats.physical = n;
+        // 读到的长度与 fstat 不符（文件正在变化）时把剩余部分顺序复制完
+        if (ok && n != st.st_size) {
+            off_t rest = 0;
+            ok = copy_with_read_write(in, out, &rest) == ENGINE_DONE;
+            stats.logical = stats.physical = n + rest;
+        }
+    } else {
+        copy_path_t used;
+        ok = copy_sparse(in, out, st.st_size, &stats, &used) == ENGINE_DONE;
+    }
+    if (ok && tc->preserve) {
+        struct timespec times[2] = { st.st_atim, st.st_mtim };
+        ok = fchmod(out, st.st_mode & 07777) == 0 && futimens(out, times) == 0;
+    }
+    if (!ok) tree_error(tc, "Failed to copy", task->src);
+    if (close(out) == -1 && ok) {
+        tree_error(tc, "Failed to close", task->dst);
+        ok = 0;
+    }
+    close(in);
+    if (ok) {
+        atomic_fetch_add(&tc->files, 1);
+        atomic_fetch_add(&tc->logical, stats.logical);
+        atomic_fetch_add(&tc->physical, stats.physical);
+    }
+}
+
+static void tree_copy_symlink(tree_copy_t *tc, tree_task_t *task)
+{
+    char target[PATH_MAX];
+    struct stat st;
+    ssize_t n;
+
+    if (lstat(task->src, &st) == -1 || (n = readlink(task->src, target, sizeof(target) - 1)) == -1) {
+        tree_error(tc, "Failed to read link", task->src);
+        return;
+    }
+    target[n] = '\0';
+    if (symlink(target, task->dst) == -1 &&
+        (errno != EEXIST || unlink(task->dst) == -1 || symlink(target, task->dst) == -1)) {
+        tree_error(tc, "Failed to create link", task->dst);
+        return;
+    }
+    if (tc->preserve) {
+        struct timespec times[2] = { st.st_atim, st.st_mtim };
+        if (utimensat(AT_FDCWD, task->dst, times, AT_SYMLINK_NOFOLLOW) == -1)
+            tree_error(tc, "Failed to set times on", task->dst);
+    }
+    atomic_fetch_add(&tc->symlinks, 1);
+}
+
+static void tree_copy_fifo(tree_copy_t *tc, tree_task_t *task)
+{
+    struct stat st;
+    if (lstat(task->src, &st) == -1) {
+        tree_error(tc, "Failed to stat", task->src);
+        return;
+    }
+    if (mkfifo(task->dst, st.st_mode & 0777) == -1 &&
+        (errno != EEXIST || unlink(task->dst) == -1 || mkfifo(task->dst, st.st_mode & 0777) == -1)) {
+        tree_error(tc, "Failed to create fifo", task->dst);
+        return;
+    }
+    if (tc->preserve) {
+        struct timespec times[2] = { st.st_atim, st.st_mtim };
+        if (chmod(task->dst, st.st_mode & 07777) == -1 ||
+            utimensat(AT_FDCWD, task->dst, times, AT_SYMLINK_NOFOLLOW) == -1)
+            tree_error(tc, "Failed to preserve attributes on", task->dst);
+    }
+    atomic_fetch_add(&tc->fifos, 1);
+}
+
+// 按随机起点轮询其他线程的队列
+static tree_task_t *tree_steal(tree_copy_t *tc, tree_worker_t *self)
+{
+    int start = rand_r(&self->seed) % tc->nworkers;
+    for (int i = 0; i < tc->nworkers; i++) {
+        tree_worker_t *victim = &tc->workers[(start + i) % tc->nworkers];
+        if (victim == self) continue;
+        tree_task_t *task = deque_steal(victim);
+        if (task) return task;
+    }
+    return NULL;
+}
+
+static void *tree_worker(void *arg)
+{
+    tree_worker_t *w = arg;
+    tree_copy_t *tc = w->tc;
+
+    for (;;) {
+        // 先记下任务序号再找任务：找不到后若序号已变，说明期间有新任务，不能睡眠
+        unsigned seq = atomic_load(&tc->work_seq);
+        tree_task_t *task = deque_pop(w);
+        if (task == NULL) task = tree_steal(tc, w);
+
+        if (task) {
+            if (task->type == TASK_DIR) tree_copy_dir(tc, w, task);
+            else if (task->type == TASK_FILE) tree_copy_file(tc, w, task);
+            else if (task->type == TASK_SYMLINK) tree_copy_symlink(tc, task);
+            else tree_copy_fifo(tc, task);
+            free(task);
+            if (atomic_fetch_sub(&tc->pending, 1) == 1) {   // 最后一个任务完成，唤醒所有线程退出
+                pthread_mutex_lock(&tc->idle_lock);
+                pthread_cond_broadcast(&tc->idle_cond);
+                pthread_mutex_unlock(&tc->idle_lock);
+            }
+            continue;
+        }
+        if (atomic_load(&tc->pending) == 0) break;
+
+        pthread_mutex_lock(&tc->idle_lock);
+        atomic_fetch_add(&tc->sleepers, 1);
+        while (atomic_load(&tc->pending) > 0 && atomic_load(&tc->work_seq) == seq)
+            pthread_cond_wait(&tc->idle_cond, &tc->idle_lock);
+        atomic_fetch_sub(&tc->sleepers, 1);
+        pthread_mutex_unlock(&tc->idle_lock);
+    }
+    return NULL;
+}
+
+/*
+ * 用 threads 个线程把 src 目录树复制到 dst（dst 不存在时创建）。
+ * 遍历目录和复制文件都是池中的任务；单个文件失败只计数并继续。
+ * @return 0 全部成功； -1 有失败项（已输出到 stderr）
+ */
+static int copy_tree(const char *src, const char *dst, int threads, int preserve)
+{
+    tree_copy_t tc = { .nworkers = threads, .preserve = preserve };
+    pthread_t tids[PARALLEL_MAX_THREADS];
+    int started = 0;
+    struct stat st;
+
+    tc.umask = umask(0);
+    umask(tc.umask);
+    if (mkdir(dst, 0700) == -1 && errno != EEXIST) {
+        perror("Failed to create destination directory");
+        return -1;
+    }
+    if (stat(dst, &st) == -1 || !S_ISDIR(st.st_mode)) {
+        fprintf(stderr, "%s is not a directory\n", dst);
+        return -1;
+    }
+    tc.dst_dev = st.st_dev;
+    tc.dst_ino = st.st_ino;
+
+    tc.workers = calloc(threads, sizeof(*tc.workers));
+    if (tc.workers == NULL) {
+        perror("calloc");
+        return -1;
+    }
+    pthread_mutex_init(&tc.idle_lock, NULL);
+    pthread_cond_init(&tc.idle_cond, NULL);
+    pthread_mutex_init(&tc.dirs_lock, NULL);
+    for (int i = 0; i < threads; i++) {
+        tc.workers[i].tc = &tc;
+        tc.workers[i].seed = i + 1;
+        pthread_mutex_init(&tc.workers[i].lock, NULL);
+        if ((tc.workers[i].small_buf = malloc(SMALL_FILE_MAX)) == NULL) {
+            perror("malloc");
+            threads = i;
+            break;
+        }
+    }
+
+    // 根目录任务在线程启动前压入，pending 不会在开始前就为 0
+    if (threads > 0) tree_push(&tc, &tc.workers[0], TASK_DIR, src, dst, NULL);
+    for (; started < threads; started++) {
+        if (pthread_create(&tids[started], NULL, tree_worker, &tc.workers[started]) != 0) {
+            perror("pthread_create");
+            break;
+        }
+    }
+    // 一个线程都没能启动时没人会处理队列中的任务
+    if (started == 0 && atomic_load(&tc.pending) > 0) {
+        tree_task_t *task = deque_pop(&tc.workers[0]);
+        free(task);
+        atomic_store(&tc.pending, 0);
+        atomic_fetch_add(&tc.errors, 1);
+    }
+    for (int i = 0; i < started; i++)
+        pthread_join(tids[i], NULL);
+
+    // 逆序设置目录权限和时间戳：子目录先于父目录，父目录的时间戳不会再被改动
+    for (size_t i = tc.dir_count; i-- > 0; ) {
+        tree_dir_meta_t *meta = &tc.dirs[i];
+        mode_t mode = preserve ? meta->mode & 07777 : meta->mode & 0777 & ~tc.umask;
+        if (chmod(meta->dst, mode) == -1) tree_error(&tc, "Failed to set mode on", meta->dst);
+        if (preserve && utimensat(AT_FDCWD, meta->dst, meta->times, 0) == -1)
+            tree_error(&tc, "Failed to set times on", meta->dst);
+        free(meta->dst);
+    }
+    free(tc.dirs);
+
+    for (int i = 0; i < tc.nworkers; i++) {
+        free(tc.workers[i].items);
+        free(tc.workers[i].small_buf);
+        pthread_mutex_destroy(&tc.workers[i].lock);
+    }
+    free(tc.workers);
+    pthread_mutex_destroy(&tc.idle_lock);
+    pthread_cond_destroy(&tc.idle_cond);
+    pthread_mutex_destroy(&tc.dirs_lock);
+
+    fprintf(stderr, "Tree copied with %d threads: %ld files, %ld directories, %ld symlinks, %ld fifos, "
+            "%lld bytes logical, %lld bytes physical",
+            started, atomic_load(&tc.files), atomic_load(&tc.directories), atomic_load(&tc.symlinks),
+            atomic_load(&tc.fifos),
+            (long long)atomic_load(&tc.logical), (long long)atomic_load(&tc.physical));
+    if (atomic_load(&tc.errors) > 0) fprintf(stderr, ", %ld errors", atomic_load(&tc.errors));
+    fprintf(stderr, ".\n");
+    return atomic_load(&tc.errors) > 0 ? -1 : 0;
+}
+
+/* ---------- -v 流水线校验复制 ---------- */
+
+// CRC32C（Castagnoli 多项式，反射形式）
+#define CRC32C_POLY 0x82F63B78u
+
+static uint32_t crc32c_table[8][256];   // slicing-by-8 查表
+
+static uint32_t crc32c_sw(uint32_t crc, const unsigned char *p, size_t n)
+{
+    while (n >= 8) {
+        uint32_t lo = crc ^ (p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24);
+        crc = crc32c_table[7][lo & 0xFF] ^ crc32c_table[6][(lo >> 8) & 0xFF] ^
+              crc32c_table[5][(lo >> 16) & 0xFF] ^ crc32c_table[4][lo >> 24] ^
+              crc32c_table[3][p[4]] ^ crc32c_table[2][p[5]] ^
+              crc32c_table[1][p[6]] ^ crc32c_table[0][p[7]];
+        p += 8;
+        n -= 8;
+    }
+    while (n--) crc = crc32c_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+#if defined(__x86_64__)
+// SSE4.2 crc32 指令每次处理 8 字节，比查表快一个数量级
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t crc, const unsigned char *p, size_t n)
+{
+    uint64_t c = crc;
+    while (n >= 8) {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        c = _mm_crc32_u64(c, v);
+        p += 8;
+        n -= 8;
+    }
+    crc = (uint32_t)c;
+    while (n--) crc = _mm_crc32_u8(crc, *p++);
+    return crc;
+}
+#endif
+
+static uint32_t (*crc32c_update)(uint32_t crc, const unsigned char *p, size_t n) = crc32c_sw;
+
+// 生成查表并按 CPU 能力选择实现
+static void crc32c_init(void)
+{
+    for (int i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) c = c & 1 ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+        crc32c_table[0][i] = c;
+    }
+    for (int i = 0; i < 256; i++)
+        for (int t = 1; t < 8; t++)
+            crc32c_table[t][i] = (crc32c_table[t - 1][i] >> 8) ^ crc32c_table[0][crc32c_table[t - 1][i] & 0xFF];
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("sse4.2")) crc32c_update = crc32c_hw;
+#endif
+}
+
+/*
+ * 读、校验、写各一个线程，通过 PIPE_SLOTS 个轮转缓冲区重叠执行：
+ * 第 i 块使用槽 i % PIPE_SLOTS，各阶段只推进自己的计数，
+ * 读线程在槽被写线程释放前等待，校验和写线程在上一阶段完成该块前等待。
+ * 目标为普通文件时另有一个校验线程从目标读回已写入的数据计算 CRC，与复制重叠进行。
+ * 源和目标都是普通文件时按 SEEK_DATA / SEEK_HOLE 读取：空洞作为不占缓冲区的“空洞块”传递，
+ * 校验线程按全零计算 CRC，写线程只扩展目标长度，目标中保持为空洞。
+ */
+typedef struct {
+    int in, out;
+    int verify_fd;              // 读回目标用的只读描述符，-1 表示不校验目标
+    int sparse;                 // 按数据段读取、保留空洞
+    off_t total;                // 源文件大小，未知时为 -1
+    char *slots[PIPE_SLOTS];
+    size_t lens[PIPE_SLOTS];
+    unsigned char holes[PIPE_SLOTS];    // 该块是空洞，slots 中没有数据
+    const char *zeros;          // BUFFER_SIZE 字节的零，空洞块按此计算 CRC
+    off_t physical_bytes;       // 实际写入的数据字节数，由写线程独占
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    unsigned long read_blocks;      // 以下计数均由 lock 保护
+    unsigned long hashed_blocks;
+    unsigned long written_blocks;
+    off_t written_bytes;
+    off_t verified_bytes;
+    int eof;                        // 读线程已到文件末尾，read_blocks 即总块数
+    int failed;
+    int err;
+    const char *failed_stage;
+
+    uint32_t src_crc;               // 由校验线程独占
+    uint32_t dst_crc;               // 由目标校验线程独占
+} pipeline_t;
+
+static void pipeline_fail(pipeline_t *pl, const char *stage, int err)
+{
+    pthread_mutex_lock(&pl->lock);
+    if (!pl->failed) {
+        pl->failed = 1;
+        pl->failed_stage = stage;
+        pl->err = err;
+    }
+    pthread_cond_broadcast(&pl->cond);
+    pthread_mutex_unlock(&pl->lock);
+}
+
+// 所有块都已写入
+static int pipeline_written(const pipeline_t *pl)
+{
+    return pl->eof && pl->written_blocks == pl->read_blocks;
+}
+
+/*
+ * 稀疏读取下一块：位于数据段时 pread 最多 BUFFER_SIZE 字节；位于空洞时不读取，
+ * 返回空洞长度（最多 HOLE_BLOCK_MAX）并置 *hole。*data_end 缓存当前数据段的结尾。
+ * @return 字节数； 0 文件结束； -1 出错
+ */
+static ssize_t sparse_read(pipeline_t *pl, char *buf, off_t *pos, off_t *data_end, int *hole)
+{
+    *hole = 0;
+    if (*pos >= *data_end) {
+        off_t data = lseek(pl->in, *pos, SEEK_DATA);
+        if (data == -1) {
+            if (errno != ENXIO) return -1;
+            if (*pos >= pl->total) return 0;
+            data = pl->total;   // 之后全是空洞，直到文件末尾
+        }
+        if (data > *pos) {
+            off_t len = data - *pos < HOLE_BLOCK_MAX ? data - *pos : HOLE_BLOCK_MAX;
+            *pos += len;
+            *hole = 1;
+            return len;
+        }
+        if ((*data_end = lseek(pl->in, data, SEEK_HOLE)) == -1) return -1;
+    }
+    size_t want = *data_end - *pos < BUFFER_SIZE ? *data_end - *pos : BUFFER_SIZE;
+    ssize_t n;
+    while ((n = pread(pl->in, buf, want, *pos)) == -1 && errno == EINTR)
+        ;
+    if (n > 0) *pos += n;
+    return n;
+}
+
+static void *pipeline_reader(void *arg)
+{
+    pipeline_t *pl = arg;
+    off_t pos = 0, data_end = 0;    // 稀疏模式的读取位置与当前数据段结尾
+    for (unsigned long i = 0; ; i++) {
+        pthread_mutex_lock(&pl->lock);
+        while (!pl->failed && i - pl->written_blocks >= PIPE_SLOTS)
+            pthread_cond_wait(&pl->cond, &pl->lock);
+        int failed = pl->failed;
+        pthread_mutex_unlock(&pl->lock);
+        if (failed) break;
+
+        ssize_t n;
+        int hole = 0;
+        if (pl->sparse) {
+            n = sparse_read(pl, pl->slots[i % PIPE_SLOTS], &pos, &data_end, &hole);
+        } else {
+            while ((n = read(pl->in, pl->slots[i % PIPE_SLOTS], BUFFER_SIZE)) == -1 && errno == EINTR)
+                ;
+        }
+        if (n == -1) {
+            pipeline_fail(pl, "Read", errno);
+            break;
+        }
+        pthread_mutex_lock(&pl->lock);
+        if (n == 0) pl->eof = 1;
+        else {
+            pl->lens[i % PIPE_SLOTS] = n;
+            pl->holes[i % PIPE_SLOTS] = hole;
+            pl->read_blocks++;
+        }
+        pthread_cond_broadcast(&pl->cond);
+        pthread_mutex_unlock(&pl->lock);
+        if (n == 0) break;
+    }
+    return NULL;
+}
+
+static void *pipeline_hasher(void *arg)
+{
+    pipeline_t *pl = arg;
+    uint32_t crc = ~0u;
+    for (unsigned long i = 0; ; i++) {
+        pthread_mutex_lock(&pl->lock);
+        while (!pl->failed && i == pl->read_blocks && !pl->eof)
+            pthread_cond_wait(&pl->cond, &pl->lock);
+        int done = pl->failed || i == pl->read_blocks;
+        pthread_mutex_unlock(&pl->lock);
+        if (done) break;
+
+        if (pl->holes[i % PIPE_SLOTS]) {
+            for (size_t left = pl->lens[i % PIPE_SLOTS]; left > 0; ) {
+                size_t n = left < BUFFER_SIZE ? left : BUFFER_SIZE;
+                crc = crc32c_update(crc, (const unsigned char *)pl->zeros, n);
+                left -= n;
+            }
+        } else {
+            crc = crc32c_update(crc, (const unsigned char *)pl->slots[i % PIPE_SLOTS], pl->lens[i % PIPE_SLOTS]);
+        }
+
+        pthread_mutex_lock(&pl->lock);
+        pl->hashed_blocks++;
+        pthread_cond_broadcast(&pl->cond);
+        pthread_mutex_unlock(&pl->lock);
+    }
+    pl->src_crc = ~crc;
+    return NULL;
+}
+
+static void *pipeline_writer(void *arg)
+{
+    pipeline_t *pl = arg;
+    for (unsigned long i = 0; ; i++) {
+        pthread_mutex_lock(&pl->lock);
+        while (!pl->failed && i == pl->hashed_blocks && !(pl->eof && i == pl->read_blocks))
+            pthread_cond_wait(&pl->cond, &pl->lock);
+        int done = pl->failed || i == pl->hashed_blocks;
+        pthread_mutex_unlock(&pl->lock);
+        if (done) break;
+
+        size_t len = pl->lens[i % PIPE_SLOTS];
+        if (pl->holes[i % PIPE_SLOTS]) {
+            // 只扩展长度并移动写位置，不写入数据；校验线程读回时得到全零
+            off_t end = pl->written_bytes + len;
+            if (ftruncate(pl->out, end) == -1 || lseek(pl->out, end, SEEK_SET) == -1) {
+                pipeline_fail(pl, "Write", errno);
+                break;
+            }
+        } else {
+            if (write_all(pl->out, pl->slots[i % PIPE_SLOTS], len) == -1) {
+                pipeline_fail(pl, "Write", errno);
+                break;
+            }
+            pl->physical_bytes += len;
+        }
+        pthread_mutex_lock(&pl->lock);
+        pl->written_blocks++;
+        pl->written_bytes += len;
+        pthread_cond_broadcast(&pl->cond);
+        pthread_mutex_unlock(&pl->lock);
+    }
+    return NULL;
+}
+
+// 从目标读回已写入的部分计算 CRC；读的是刚写入的页缓存，几乎不增加耗时
+static void *pipeline_verifier(void *arg)
+{
+    pipeline_t *pl = arg;
+    uint32_t crc = ~0u;
+    char *buffer = malloc(BUFFER_SIZE);
+    off_t off = 0;
+
+    if (buffer == NULL) {
+        pipeline_fail(pl, "Verify", errno);
+        return NULL;
+    }
+    for (;;) {
+        pthread_mutex_lock(&pl->lock);
+        while (!pl->failed && off == pl->written_bytes && !pipeline_written(pl))
+            pthread_cond_wait(&pl->cond, &pl->lock);
+        off_t end = pl->written_bytes;
+        int done = pl->failed || off == end;
+        pthread_mutex_unlock(&pl->lock);
+        if (done) break;
+
+        while (off < end) {
+            size_t want = end - off < BUFFER_SIZE ? end - off : BUFFER_SIZE;
+            ssize_t n = pread(pl->verify_fd, buffer, want, off);
+            if (n == -1 && errno == EINTR) continue;
+            if (n <= 0) {
+                pipeline_fail(pl, "Verify", n == 0 ? EIO : errno);
+                free(buffer);
+                return NULL;
+            }
+            crc = crc32c_update(crc, (const unsigned char *)buffer, n);
+            off += n;
+        }
+        pthread_mutex_lock(&pl->lock);
+        pl->verified_bytes = off;
+        pthread_cond_broadcast(&pl->cond);
+        pthread_mutex_unlock(&pl->lock);
+    }
+    free(buffer);
+    pl->dst_crc = ~crc;
+    return NULL;
+}
+
+static double elapsed_seconds(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void add_ms(struct timespec *ts, long ms)
+{
+    ts->tv_nsec += ms * 1000000L;
+    ts->tv_sec += ts->tv_nsec / 1000000000L;
+    ts->tv_nsec %= 1000000000L;
+}
+
+static void format_bytes(char *out, size_t cap, double bytes)
+{
+    const char *units[] = { "B", "KiB", "MiB", "GiB", "TiB" };
+    int u = 0;
+    while (bytes >= 1024 && u < 4) {
+        bytes /= 1024;
+        u++;
+    }
+    snprintf(out, cap, "%.1f %s", bytes, units[u]);
+}
+
+// 单行进度：已写入 / 总量、百分比、吞吐量、剩余时间（总量未知时省略）
+static void print_progress(off_t done, off_t total, double seconds)
+{
+    char done_str[32], total_str[32], rate_str[32];
+    double rate = seconds > 0 ? done / seconds : 0;
+
+    format_bytes(done_str, sizeof(done_str), done);
+    format_bytes(rate_str, sizeof(rate_str), rate);
+    if (total > 0) {
+        long eta = rate > 0 ? (long)((total - done) / rate) : 0;
+        format_bytes(total_str, sizeof(total_str), total);
+        fprintf(stderr, "\r%s / %s  %3d%%  %s/s  ETA %02ld:%02ld\033[K", done_str, total_str,
+                (int)(done * 100 / total), rate_str, eta / 60, eta % 60);
+    } else {
+        fprintf(stderr, "\r%s  %s/s\033[K", done_str, rate_str);
+    }
+}
+
+/*
+ * 流水线复制并校验。
+ * 目标是普通文件时读回目标计算 CRC 并与源比较，*verified 置 1；否则只计算源的 CRC。
+ * 标准错误是终端时每 PROGRESS_INTERVAL_MS 刷新一次进度行。
+ * @return 0 成功； -1 读写出错或校验不一致（已输出原因）
+ */
+static int copy_verified(int in, int out, const char *destination_file,
+                         copy_stats_t *stats, uint32_t *crc, int *verified)
+{
+    pipeline_t pl = { .in = in, .out = out, .verify_fd = -1, .total = -1 };
+    pthread_t reader, hasher, writer, verifier;
+    int stages = 0, ret = -1;
+    struct stat in_st, out_st;
+    struct timespec start;
+
+    crc32c_init();
+    if (fstat(in, &in_st) == 0 && S_ISREG(in_st.st_mode) && in_st.st_size > 0) {
+        pl.total = in_st.st_size;
+        posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+    if (fstat(out, &out_st) == 0 && S_ISREG(out_st.st_mode)) {
+        pl.verify_fd = open(destination_file, O_RDONLY);
+        // 文件系统支持 SEEK_DATA 时保留空洞（ENXIO 表示源全是空洞）
+        if (pl.total > 0 && (lseek(in, 0, SEEK_DATA) != -1 || errno == ENXIO))
+            pl.sparse = (pl.zeros = calloc(1, BUFFER_SIZE)) != NULL;
+        lseek(in, 0, SEEK_SET);     // 探测可能移动了偏移，非稀疏模式按偏移顺序读取
+    }
+
+    for (int i = 0; i < PIPE_SLOTS; i++) {
+        if ((pl.slots[i] = malloc(BUFFER_SIZE)) == NULL) {
+            perror("malloc");
+            goto out;
+        }
+    }
+    pthread_mutex_init(&pl.lock, NULL);
+    pthread_cond_init(&pl.cond, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    void *(*stage_fn[])(void *) = { pipeline_reader, pipeline_hasher, pipeline_writer, pipeline_verifier };
+    pthread_t *stage_tid[] = { &reader, &hasher, &writer, &verifier };
+    int nstages = pl.verify_fd == -1 ? 3 : 4;
+    for (; stages < nstages; stages++) {
+        int err = pthread_create(stage_tid[stages], NULL, stage_fn[stages], &pl);
+        if (err != 0) {
+            pipeline_fail(&pl, "Thread creation", err);
+            break;
+        }
+    }
+
+    // 主线程只负责刷新进度，定时醒来一次，不参与数据路径
+    int show = isatty(STDERR_FILENO);
+    // 各阶段每处理一块都会广播，截止时间只在到期后推进，否则高速复制时永远等不到超时
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    add_ms(&deadline, PROGRESS_INTERVAL_MS);
+    pthread_mutex_lock(&pl.lock);
+    while (!pl.failed && !(pipeline_written(&pl) && (pl.verify_fd == -1 || pl.verified_bytes == pl.written_bytes))) {
+        if (pthread_cond_timedwait(&pl.cond, &pl.lock, &deadline) != ETIMEDOUT) continue;
+        if (show) print_progress(pl.written_bytes, pl.total, elapsed_seconds(&start));
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        add_ms(&deadline, PROGRESS_INTERVAL_MS);
+    }
+    pthread_mutex_unlock(&pl.lock);
+
+    for (int i = 0; i < stages; i++)
+        pthread_join(*stage_tid[i], NULL);
+    if (show) {
+        print_progress(pl.written_bytes, pl.total, elapsed_seconds(&start));
+        fprintf(stderr, "\n");
+    }
+    pthread_mutex_destroy(&pl.lock);
+    pthread_cond_destroy(&pl.cond);
+
+    stats->logical = pl.written_bytes;
+    stats->physical = pl.physical_bytes;
+    *crc = pl.src_crc;
+    *verified = pl.verify_fd != -1;
+    if (pl.failed) {
+        fprintf(stderr, "%s failed: %s\n", pl.failed_stage, strerror(pl.err));
+    } else if (*verified && pl.dst_crc != pl.src_crc) {
+        fprintf(stderr, "Verification failed: source crc32c %08x, destination crc32c %08x\n",
+                pl.src_crc, pl.dst_crc);
+    } else {
+        ret = 0;
+    }
+
+out:
+    for (int i = 0; i < PIPE_SLOTS; i++)
+        free(pl.slots[i]);
+    if (pl.verify_fd != -1) close(pl.verify_fd);
+    free((void *)pl.zeros);
+    return ret;
+}
 
 int main(int argc, char *argv[])
 {
-    // 检查命令行参数是否正确（程序名 + 2 个参数）
-    if (argc != 3) {
-        fprintf(stderr, "Usage: %s <source_file> <destination_file>\n", argv[0]);
+    int threads = 0;    // -j N：并行线程数，0 表示单线程（-r 时为 CPU 核数）
+    int recursive = 0;  // -r：递归复制目录
+    int preserve = 0;   // -p：保留权限和时间戳
+    int verify = 0;     // -v：流水线复制并校验
+    int opt;
+
+    while ((opt = getopt(argc, argv, "j:rpv")) != -1) {
+        if (opt == 'j') {
+            threads = atoi(optarg);
+            if (threads < 1 || threads > PARALLEL_MAX_THREADS) {
+                fprintf(stderr, "-j must be between 1 and %d\n", PARALLEL_MAX_THREADS);
+                return EXIT_FAILURE;
+            }
+        } else if (opt == 'r') {
+            recursive = 1;
+        } else if (opt == 'p') {
+            preserve = 1;
+        } else if (opt == 'v') {
+            verify = 1;
+        } else {
+            threads = -1;
+            break;
+        }
+    }
+
+    // 检查命令行参数是否正确（选项之后应为 2 个参数）
+    if (threads < 0 || argc - optind != 2 || (verify && (threads > 0 || recursive))) {
+        fprintf(stderr, "Usage: %s [-p] [-j threads] <source_file> <destination_file>\n"
+                        "       %s [-p] -v <source_file> <destination_file>\n"
+                        "       %s -r [-p] [-j threads] <source_dir> <destination_dir>\n", argv[0], argv[0], argv[0]);
         return EXIT_FAILURE;  // 参数错误，退出程序
     }
 
-    const char *source_file = argv[1];      // 获取源文件名
-    const char *destination_file = argv[2]; // 获取目标文件名
+    const char *source_file = argv[optind];          // 获取源文件名
+    const char *destination_file = argv[optind + 1]; // 获取目标文件名
+
+    // 源是目录时按目录树复制
+    struct stat src_st;
+    if (recursive && stat(source_file, &src_st) == 0 && S_ISDIR(src_st.st_mode)) {
+        if (threads == 0) {
+            long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+            threads = ncpu < 1 ? 1 : ncpu > PARALLEL_MAX_THREADS ? PARALLEL_MAX_THREADS : ncpu;
+        }
+        return copy_tree(source_file, destination_file, threads, preserve) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
     // 以只读模式打开源文件
     int source_fd = open(source_file, O_RDONLY);
@@ -32,31 +1408,42 @@ int main(int argc, char *argv[])
         return EXIT_FAILURE;
     }
 
-    char buffer[BUFFER_SIZE];  // 用于存储读取的文件内容
-    ssize_t bytes_read;        // 存储 `read` 返回的字节数
+    copy_stats_t stats;         // 逻辑 / 物理字节数
+    copy_path_t used;           // 实际使用的复制方式
+    int ret;
+    struct stat in_st, out_st;
+    uint32_t crc = 0;           // -v：源数据的 CRC32C
+    int verified = 0;           // -v：目标已读回比较
 
-    // 逐块读取源文件，并写入目标文件
-    while ((bytes_read = read(source_fd, buffer, BUFFER_SIZE)) > 0) {
-        ssize_t bytes_written = write(destination_fd, buffer, bytes_read);  // 写入文件
-        if (bytes_written == -1) {  // 写入失败
-            perror("Failed to write to destination file");
-            close(source_fd);
-            close(destination_fd);
-            return EXIT_FAILURE;
-        }
-        if (bytes_written != bytes_read) {  // 检查是否完全写入
-            fprintf(stderr, "Warning: Written bytes do not match read bytes\n");
-        }
+    // 只有普通文件之间且大于一个分块时才值得并行，其余情况按文件类型选择最快的单线程方式
+    int parallel = threads > 1 &&
+                   fstat(source_fd, &in_st) == 0 && fstat(destination_fd, &out_st) == 0 &&
+                   S_ISREG(in_st.st_mode) && S_ISREG(out_st.st_mode) && in_st.st_size > PARALLEL_MIN_CHUNK;
+    if (verify) {
+        used = COPY_PATH_PIPELINE;
+        ret = copy_verified(source_fd, destination_fd, destination_file, &stats, &crc, &verified);
+    } else if (parallel) {
+        ret = copy_parallel(source_fd, destination_fd, &in_st, threads, &stats, &used);
+    } else {
+        ret = copy_fd(source_fd, destination_fd, &stats, &used);
     }
 
-    // 检查 `read` 是否遇到错误
-    if (bytes_read == -1) {
-        perror("Failed to read from source file");
+    if (ret == -1) {
         close(source_fd);
         close(destination_fd);
+        // 并行模式下目标已预分配到完整大小、校验模式下目标可能与源不一致，删除以免被误用
+        if ((parallel || verify) && stat(destination_file, &out_st) == 0 && S_ISREG(out_st.st_mode))
+            unlink(destination_file);
         return EXIT_FAILURE;
     }
 
+    // -p：目标为普通文件时保留源文件的权限和时间戳
+    if (preserve && fstat(source_fd, &in_st) == 0 && fstat(destination_fd, &out_st) == 0 && S_ISREG(out_st.st_mode)) {
+        struct timespec times[2] = { in_st.st_atim, in_st.st_mtim };
+        if (fchmod(destination_fd, in_st.st_mode & 07777) == -1 || futimens(destination_fd, times) == -1)
+            perror("Failed to preserve attributes");
+    }
+
     // 关闭源文件
     if (close(source_fd) == -1) {
         perror("Failed to close source file");
@@ -70,6 +1457,11 @@ int main(int argc, char *argv[])
         return EXIT_FAILURE;
     }
 
-    printf("File copied successfully.\n");  // 复制成功
+    // 复制成功，报告实际使用的复制方式以及逻辑 / 物理字节数（写到 stderr：目标可能就是 stdout）
+    fprintf(stderr, "File copied successfully via %s", copy_path_name[used]);
+    if (parallel && used != COPY_PATH_REFLINK) fprintf(stderr, ", %d threads", threads);
+    fprintf(stderr, ": %lld bytes logical, %lld bytes physical", (long long)stats.logical, (long long)stats.physical);
+    if (verify) fprintf(stderr, ", crc32c %08x %s", crc, verified ? "verified" : "(destination not re-readable, not verified)");
+    fprintf(stderr, ".\n");
     return EXIT_SUCCESS;
 }
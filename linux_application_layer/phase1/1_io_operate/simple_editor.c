@@ -3,139 +3,459 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <ncurses.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 #include <sys/syslog.h>
+#include <termios.h>
 #include <unistd.h>
 #include <syslog.h>
 
-#define EXPAND_NUM  100 // 扩展数
+/*
+ * 文本以片段表（piece table）存储：
+ *   原始缓冲区保存打开时的文件内容，只读；
+ *   追加缓冲区保存所有新输入的字符，只追加不修改，由若干固定大小、各自 mmap 的段组成；
+ *   文档 = 按顺序排列的片段，每个片段引用某个缓冲区中的一段。
+ * 片段组织成按文档位置排序的平衡树（treap），每个节点记录子树的总长度和总换行数，
+ * 于是“第 n 行从哪里开始”和“在位置 p 插入 / 删除”都只需沿树下降一次，为 O(log n)。
+ * 每个缓冲区另有一个换行符位置数组，片段内的换行数与第 k 个换行位置用二分查找得到。
+ *
+ * 原始缓冲区是对文件的只读映射（mmap）：未编辑的部分始终直接引用映射，
+ * 只有新输入的字符进入追加缓冲区。原始缓冲区的换行索引由后台线程建立，
+ * 建立期间直接从映射显示，光标可以在已索引的行内移动；编辑和保存要等索引全部完成。
+ */
 
-// 行 链表
-typedef struct line{
-    char *content;  // 行内容
-    int length;     // 当前行的长度
-    int capacity;   // 当前行的最大容量（可动态扩展）
-    struct line *next;
-}line;
+#define BUF_ORIG 0  // 原始缓冲区
+#define BUF_ADD  1  // 追加缓冲区的第一段，之后的段依次编号
+#define ADD_SEGMENT_SIZE (1024 * 1024)  // 追加缓冲区每段的大小
 
-line *text = NULL;  // 动态链表存储文本行
-static int line_count = 0;      // 当前使用的行数
-static int current_row = 0;     // 当前编辑行
-static int current_col = 0;     // 当前编辑列
+// 缓冲区
+typedef struct{
+    char *data;
+    size_t len;
+    size_t cap;
+    size_t *lf;         // 换行符在 data 中的位置，升序
+    size_t lf_count;
+    size_t lf_cap;
+}text_buf;
 
-void printf_line(void)
+// 片段 - treap 节点
+typedef struct piece{
+    struct piece *left, *right;
+    unsigned prio;      // 堆优先级（随机），保证树高期望为 O(log n)
+    int buf;            // 所在缓冲区在 bufs 中的下标
+    size_t start;       // 在缓冲区中的起始位置
+    size_t len;         // 长度
+    size_t lf;          // 本片段中的换行数
+    size_t sub_len;     // 子树总长度
+    size_t sub_lf;      // 子树总换行数
+}piece;
+
+static text_buf *bufs = NULL;   // bufs[BUF_ORIG] 为原始缓冲区，其后为追加缓冲区的各段
+static int buf_count = 0;
+static int buf_cap = 0;
+static piece *root = NULL;      // 文档
+static size_t current_row = 0;  // 当前编辑行
+static size_t current_col = 0;  // 当前编辑列
+
+/*
+ * 视口：屏幕只显示从 top_row 行、left_col 列开始的一块区域，最后一行为状态栏。
+ * dirty[y] 标记第 y 个屏幕行自上一帧以来是否需要重绘；
+ * 每帧只重绘脏行和状态栏，再用 wnoutrefresh + doupdate 一次性输出。
+ */
+static size_t top_row = 0;      // 视口第一行对应的文档行
+static size_t left_col = 0;     // 视口第一列对应的文档列
+static unsigned char *dirty = NULL;
+static int dirty_rows = 0;      // dirty 数组长度（文本区行数）
+static const char *file_name = "";
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024                // 单次 writev 的最大 iovec 数
+#endif
+#define INDEX_CHUNK (1024 * 1024)   // 后台线程每次索引的字节数，之后更新进度、检查取消
+#define INDEX_POLL_MS 100           // 索引期间刷新进度的间隔
+
+static size_t orig_doc_len = 0;     // 原始文件内容在文档中的长度（去掉末尾换行）
+static int orig_mapped = 0;         // 原始缓冲区是映射而不是 malloc 的内存
+static int load_failed = 0;         // 文件未能载入，退出时不能保存，否则会清空原文件
+static int modified = 0;            // 有未保存的修改
+static pthread_t index_thread;
+static int indexing = 0;            // 后台索引线程运行中，片段树还不可用，只能在已索引的行内移动
+static pthread_mutex_t index_lock = PTHREAD_MUTEX_INITIALIZER;   // 保护原始缓冲区的换行索引
+static pthread_cond_t index_cond = PTHREAD_COND_INITIALIZER;     // 每索引完一块广播一次
+static atomic_size_t indexed_bytes; // 已索引的字节数
+static atomic_int index_done;       // 后台线程已结束
+static atomic_int index_cancel;     // 要求后台线程提前结束
+
+/* ---------- 缓冲区 ---------- */
+
+// 第一个不小于 pos 的换行符在 lf 数组中的下标
+static size_t lf_lower_bound(const text_buf *b, size_t pos)
 {
-    line *p=text;
-    // syslog(LOG_INFO, "line_count:%d行", line_count);
-    int i=0;
-    while(p) {
-        // syslog(LOG_INFO, "链表%d:%s",i,p->content);
-        i++;
-        p = p->next;
+    size_t lo = 0, hi = b->lf_count;
+    while(lo < hi){
+        size_t mid = lo + (hi - lo) / 2;
+        if(b->lf[mid] < pos) lo = mid + 1;
+        else hi = mid;
     }
+    return lo;
 }
 
-// 插入 - 链表
-static void insert_text(int index,const char* content)
+// 记录 data[from, to) 中的换行符位置
+static int index_newlines(text_buf *b, size_t from, size_t to)
 {
-    line * p = text;
-    line * node =  (line *)malloc(sizeof(line));
-    if(content!=NULL){
-        int len = strlen(content);  // 不包含字符串结束符'\0'
-        node->content = (char *)malloc((len+1)*sizeof(char));
-        strcpy(node->content, content);
-        node->length = len;
-        node->capacity = len;
-    }else{
-        node->content = (char *)malloc((EXPAND_NUM+1)*sizeof(char));
-        node->length = 0;
-        node->content[0] = '\0';
-        node->capacity = EXPAND_NUM;
-    }
-    if(index == 0){         // 头节点
-        if(text == NULL){
-            node->next =NULL;
-            text = node;
-        }else{
-            free(node->content);
-            free(node);
+    for(const char *p = b->data + from, *end = b->data + to; (p = memchr(p, '\n', end - p)) != NULL; p++){
+        if(b->lf_count == b->lf_cap){
+            size_t cap = b->lf_cap ? b->lf_cap * 2 : 1024;
+            size_t *lf = (size_t *)realloc(b->lf, cap * sizeof(size_t));
+            if(lf == NULL) return -1;
+            b->lf = lf;
+            b->lf_cap = cap;
         }
-        return;
+        b->lf[b->lf_count++] = p - b->data;
+    }
+    return 0;
+}
+
+// 新增一个空缓冲区；数组扩容只搬移 text_buf 结构本身，各缓冲区数据的地址不变
+static text_buf *new_buf(void)
+{
+    if(buf_count == buf_cap){
+        int cap = buf_cap ? buf_cap * 2 : 8;
+        text_buf *b = (text_buf *)realloc(bufs, cap * sizeof(text_buf));
+        if(b == NULL) return NULL;
+        bufs = b;
+        buf_cap = cap;
+    }
+    memset(&bufs[buf_count], 0, sizeof(text_buf));
+    return &bufs[buf_count++];
+}
+
+/*
+ * 追加到追加缓冲区，返回起始位置，*seg 为所在段；失败返回 (size_t)-1
+ * 当前段放不下时新映射一段，已有的段从不移动：后台保存线程可以直接引用其中已写入的内容，
+ * 主线程同时继续追加。
+ */
+static size_t add_buffer_append(const char *s, size_t n, int *seg)
+{
+    text_buf *b = buf_count > BUF_ADD ? &bufs[buf_count - 1] : NULL;
+    if(b == NULL || n > b->cap - b->len){
+        size_t size = n > ADD_SEGMENT_SIZE ? n : ADD_SEGMENT_SIZE;
+        void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(data == MAP_FAILED) return (size_t)-1;
+        if((b = new_buf()) == NULL){
+            munmap(data, size);
+            return (size_t)-1;
+        }
+        b->data = (char *)data;
+        b->cap = size;
     }
-    while(--index && p->next) {
-        p = p->next;
+    size_t start = b->len;
+    memcpy(b->data + start, s, n);
+    b->len += n;
+    if(index_newlines(b, start, b->len) == -1){
+        b->len = start;
+        return (size_t)-1;
     }
-    node->next = p->next;
-    p->next = node;
+    *seg = b - bufs;
+    return start;
 }
 
-// 释放某个结点
-static void delete_text(int index)
+/* ---------- 片段树 ---------- */
+
+static size_t sub_len(const piece *p) { return p ? p->sub_len : 0; }
+static size_t sub_lf(const piece *p)  { return p ? p->sub_lf : 0; }
+
+static void update(piece *p)
 {
-    if (text == NULL) return;  // 链表为空，直接返回
+    p->sub_len = sub_len(p->left) + p->len + sub_len(p->right);
+    p->sub_lf = sub_lf(p->left) + p->lf + sub_lf(p->right);
+}
 
-    line *p = text;
-    line *q = NULL;
+static piece *new_piece(int buf, size_t start, size_t len, unsigned prio)
+{
+    piece *p = (piece *)malloc(sizeof(piece));
+    if(p == NULL) return NULL;
+    const text_buf *b = &bufs[buf];
+    p->left = p->right = NULL;
+    p->prio = prio;
+    p->buf = buf;
+    p->start = start;
+    p->len = len;
+    p->lf = lf_lower_bound(b, start + len) - lf_lower_bound(b, start);
+    update(p);
+    return p;
+}
 
-    // 删除头结点
-    if (index == 0) {
-        text = text->next;
-        free(p->content);  // 释放字符串内容
-        free(p);           // 释放节点
-        return;
+static piece *merge(piece *a, piece *b)
+{
+    if(!a) return b;
+    if(!b) return a;
+    if(a->prio > b->prio){
+        a->right = merge(a->right, b);
+        update(a);
+        return a;
     }
+    b->left = merge(a, b->left);
+    update(b);
+    return b;
+}
 
-    // 遍历找到 index 位置的节点
-    while (index-- && p->next) {
-        q = p;
-        p = p->next;
+/*
+ * 按文档位置拆分：*l 为前 pos 个字符，*r 为其余部分。
+ * pos 落在某个片段中间时把它拆成两个片段，右半继承原节点的优先级，堆性质不变。
+ * @return 0 成功； -1 内存不足（树保持不变）
+ */
+static int split(piece *t, size_t pos, piece **l, piece **r)
+{
+    if(!t){
+        *l = *r = NULL;
+        return 0;
     }
+    size_t left_len = sub_len(t->left);
+    if(pos <= left_len){
+        piece *ll, *lr;
+        if(split(t->left, pos, &ll, &lr) == -1) return -1;
+        t->left = lr;
+        update(t);
+        *l = ll;
+        *r = t;
+    }else if(pos >= left_len + t->len){
+        piece *rl, *rr;
+        if(split(t->right, pos - left_len - t->len, &rl, &rr) == -1) return -1;
+        t->right = rl;
+        update(t);
+        *l = t;
+        *r = rr;
+    }else{
+        size_t k = pos - left_len;
+        piece *tail = new_piece(t->buf, t->start + k, t->len - k, t->prio);
+        if(tail == NULL) return -1;
+        tail->right = t->right;
+        update(tail);
+        t->len = k;
+        t->lf -= tail->lf;
+        t->right = NULL;
+        update(t);
+        *l = t;
+        *r = tail;
+    }
+    return 0;
+}
 
-    if (p) { // 确保 p 不是 NULL
-        q->next = p->next;  // 跳过当前节点
-        free(p->content);    // 释放字符串内容
-        free(p);             // 释放节点
+static void free_tree(piece *t)
+{
+    if(!t) return;
+    free_tree(t->left);
+    free_tree(t->right);
+    free(t);
+}
+
+// 最右片段正好结束在追加段 seg 的 add_start 处时直接延长它（连续输入不产生新片段）
+static int extend_last(piece *t, int seg, size_t add_start, size_t n)
+{
+    if(!t) return 0;
+    if(t->right){
+        if(!extend_last(t->right, seg, add_start, n)) return 0;
+    }else{
+        if(t->buf != seg || t->start + t->len != add_start) return 0;
+        const text_buf *b = &bufs[seg];
+        t->len += n;
+        t->lf += lf_lower_bound(b, add_start + n) - lf_lower_bound(b, add_start);
     }
+    update(t);
+    return 1;
+}
+
+/* ---------- 文档操作 ---------- */
+
+/*
+ * 索引期间文档就是原始缓冲区，行位置直接取自后台线程正在增长的换行索引（持 index_lock 读取）。
+ * 只有换行符已被索引的行才算完整，调用方先用 wait_indexed 等到需要的行。
+ */
+static size_t indexed_lines(void)
+{
+    pthread_mutex_lock(&index_lock);
+    size_t n = bufs[BUF_ORIG].lf_count;
+    pthread_mutex_unlock(&index_lock);
+    return n ? n : 1;
+}
+
+// 第 row 个换行符之后的位置（row 为 0 时为 0）
+static size_t indexed_line_start(size_t row)
+{
+    if(row == 0) return 0;
+    pthread_mutex_lock(&index_lock);
+    size_t pos = bufs[BUF_ORIG].lf[row - 1] + 1;
+    pthread_mutex_unlock(&index_lock);
+    return pos;
+}
+
+static size_t doc_length(void) { return sub_len(root); }
+static size_t doc_lines(void)  { return indexing ? indexed_lines() : sub_lf(root) + 1; }
+
+// 第 row 行（从 0 开始）的起始位置
+static size_t line_start(size_t row)
+{
+    if(indexing) return indexed_line_start(row);
+    if(row == 0) return 0;
+    size_t k = row;     // 要找第 k 个换行符（从 1 开始）
+    size_t pos = 0;
+    piece *t = root;
+    while(t){
+        if(k <= sub_lf(t->left)){
+            t = t->left;
+            continue;
+        }
+        k -= sub_lf(t->left);
+        pos += sub_len(t->left);
+        if(k <= t->lf){
+            const text_buf *b = &bufs[t->buf];
+            size_t nl = b->lf[lf_lower_bound(b, t->start) + k - 1];
+            return pos + (nl - t->start) + 1;
+        }
+        k -= t->lf;
+        pos += t->len;
+        t = t->right;
+    }
+    return doc_length();
+}
+
+// 第 row 行的长度（不含换行符）
+static size_t line_length(size_t row)
+{
+    if(indexing) return indexed_line_start(row + 1) - 1 - indexed_line_start(row);
+    size_t end = row + 1 < doc_lines() ? line_start(row + 1) - 1 : doc_length();
+    return end - line_start(row);
+}
+
+// 读取 [pos, pos + n) 到 out，只访问与区间相交的子树
+static void read_range(const piece *t, size_t base, size_t pos, size_t n, char *out)
+{
+    if(!t || n == 0) return;
+    size_t left_len = sub_len(t->left);
+    size_t self = base + left_len;
+    if(pos < self)
+        read_range(t->left, base, pos, n, out);
+    size_t from = pos > self ? pos : self;
+    size_t to = pos + n < self + t->len ? pos + n : self + t->len;
+    if(from < to)
+        memcpy(out + (from - pos), bufs[t->buf].data + t->start + (from - self), to - from);
+    if(pos + n > self + t->len)
+        read_range(t->right, self + t->len, pos, n, out);
+}
+
+// 在位置 pos 插入 n 个字符
+static int doc_insert(size_t pos, const char *s, size_t n)
+{
+    int seg;
+    size_t start = add_buffer_append(s, n, &seg);
+    if(start == (size_t)-1) return -1;
+
+    piece *l, *r;
+    if(split(root, pos, &l, &r) == -1) return -1;
+    if(!extend_last(l, seg, start, n)){
+        piece *p = new_piece(seg, start, n, (unsigned)rand());
+        if(p == NULL){
+            root = merge(l, r);
+            return -1;
+        }
+        l = merge(l, p);
+    }
+    root = merge(l, r);
+    return 0;
+}
+
+// 删除 [pos, pos + n)
+static int doc_delete(size_t pos, size_t n)
+{
+    piece *l, *m, *r;
+    if(split(root, pos, &l, &r) == -1) return -1;
+    if(split(r, n, &m, &r) == -1){
+        root = merge(l, r);
+        return -1;
+    }
+    free_tree(m);
+    root = merge(l, r);
+    return 0;
 }
 
 // 释放 文本编辑缓冲区
 static void free_text(void)
 {
-    line * p = text;
-    while(p) {
-        line *next = p->next;
-        free(p->content);
-        free(p);
-        p = next;
+    free_tree(root);
+    root = NULL;
+    for(int i = 0; i < buf_count; i++){
+        if(i != BUF_ORIG) munmap(bufs[i].data, bufs[i].cap);
+        else if(orig_mapped) munmap(bufs[i].data, bufs[i].len);
+        free(bufs[i].lf);
     }
-    text = NULL;
+    free(bufs);
+    bufs = NULL;
+    buf_count = buf_cap = 0;
 }
 
-// 扩展某一行的列数
-static void expand_col(line * node,int expand)
+// 后台线程：按块扫描映射，建立原始缓冲区的换行索引
+static void *index_worker(void *arg)
 {
-    if(expand == 0){
-        if(node){
-            node->capacity+=EXPAND_NUM;
-            node->content = (char *)realloc(node->content, node->capacity+1);
-        }
-    }else{
-        if(node){
-            node->capacity+=expand;
-            node->content = (char *)realloc(node->content, node->capacity+1);
+    text_buf *b = &bufs[BUF_ORIG];
+    intptr_t ret = 0;
+    (void)arg;
+    for(size_t pos = 0; pos < b->len && !atomic_load(&index_cancel); ){
+        size_t end = b->len - pos < INDEX_CHUNK ? b->len : pos + INDEX_CHUNK;
+        pthread_mutex_lock(&index_lock);    // 主线程同时在读已建立的索引，扩容会移动 lf 数组
+        int err = index_newlines(b, pos, end);
+        pthread_cond_broadcast(&index_cond);
+        pthread_mutex_unlock(&index_lock);
+        if(err == -1){
+            ret = -1;
+            break;
         }
+        pos = end;
+        atomic_store(&indexed_bytes, pos);
+    }
+    pthread_mutex_lock(&index_lock);
+    atomic_store(&index_done, 1);
+    pthread_cond_broadcast(&index_cond);
+    pthread_mutex_unlock(&index_lock);
+    return (void *)ret;
+}
+
+// 等待后台索引结束并建立片段树
+static void finish_indexing(void)
+{
+    if(!indexing) return;
+    void *ret;
+    pthread_join(index_thread, &ret);
+    indexing = 0;
+    madvise(bufs[BUF_ORIG].data, bufs[BUF_ORIG].len, MADV_NORMAL);
+    if(ret != NULL || atomic_load(&index_cancel)){
+        load_failed = 1;
+        return;
     }
+    if(orig_doc_len > 0 && (root = new_piece(BUF_ORIG, 0, orig_doc_len, (unsigned)rand())) == NULL)
+        load_failed = 1;
 }
 
-// 从文件读取内容到数组上
+// 映射文件到原始缓冲区，换行索引在后台建立
 static void read_file(char *filename)
 {
+    if(new_buf() == NULL){      // bufs[BUF_ORIG]，空文件时保持为空
+        perror("malloc");
+        load_failed = 1;
+        return;
+    }
+
     // 检查文件是否存在
     if(access(filename, F_OK) != 0){    // 若文件不存在
         FILE *fp = fopen(filename,"w");            // 创建文件
         if (fp) {
-            line_count = 1;
-            insert_text(0, NULL);
             fclose(fp);
         } else {
             perror("fopen(w)");
@@ -144,203 +464,572 @@ static void read_file(char *filename)
     }
 
     // 以只读方式打开文件
-    FILE *fp = fopen(filename, "r");
-    if(fp == NULL){
-        perror("fopen(r)");
+    int fd = open(filename, O_RDONLY);
+    struct stat st;
+    if(fd == -1 || fstat(fd, &st) == -1){
+        perror("open");
+        if(fd != -1) close(fd);
+        load_failed = 1;
+        return;
+    }
+    if(st.st_size == 0){    // 空文件无法映射，也不需要
+        close(fd);
         return;
     }
 
-    line_count = 0;
-    char buffer[EXPAND_NUM] = {0};  // 用于读取文件一行内容
-    
-    // 逐行读取文件内容
-    while(fgets(buffer, EXPAND_NUM, fp)!=NULL){
-        size_t len = strlen(buffer);
-        char *buf = (char *)calloc(EXPAND_NUM, sizeof(char));
-        int length = EXPAND_NUM;
-        strcpy(buf, buffer);
-
-        // 处理超长行
-        while(buffer[len-1] != '\n' && !feof(fp)){  // 如果没遇到 换行 或者没到文件末尾
-            if(fgets(buffer,EXPAND_NUM,fp)!=NULL){
-                len = strlen(buffer);
-                length+=len;
-                buf = (char *)realloc(buf, length);
-                strcat(buf, buffer);   // 拼接
-            }
+    // 映射整个文件，只有访问到的页才会从磁盘读入
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // 映射建立后不再需要文件描述符
+    if(map == MAP_FAILED){
+        perror("mmap");
+        load_failed = 1;
+        return;
+    }
+    text_buf *b = &bufs[BUF_ORIG];
+    b->data = (char *)map;
+    b->len = b->cap = st.st_size;
+    orig_mapped = 1;
+
+    // 保存时每行都以换行结尾，所以文件末尾的换行不作为一个新的空行
+    orig_doc_len = b->len;
+    if(b->data[orig_doc_len - 1] == '\n') orig_doc_len--;
+
+    madvise(map, st.st_size, MADV_SEQUENTIAL);  // 索引期间顺序预读
+    indexing = 1;
+    if(pthread_create(&index_thread, NULL, index_worker, NULL) != 0){
+        indexing = 0;   // 无法创建线程时在当前线程建立索引
+        if(index_newlines(b, 0, b->len) == -1 ||
+           (orig_doc_len > 0 && (root = new_piece(BUF_ORIG, 0, orig_doc_len, (unsigned)rand())) == NULL))
+            load_failed = 1;
+    }
+}
+
+/*
+ * 保存：
+ *   原始缓冲区映射着原文件，不能原地截断重写。先在同目录建临时文件，
+ *   按文档顺序把每个片段作为一个 iovec 用 writev 成批写出——未修改的部分直接从映射写出，
+ *   新输入的部分直接从追加缓冲区写出，用户态不再复制；写完 fsync 再 rename 覆盖原文件，
+ *   最后 fsync 目录使改名落盘。任何一步失败原文件都保持不变。
+ * 保存前在主线程拍下片段快照（iovec 数组），之后只读快照：映射和追加缓冲区中已有的内容
+ * 不会改变、地址不会移动，所以写盘可以放到后台线程，界面同时继续编辑。
+ */
+typedef struct{
+    char *path;             // 目标文件
+    struct iovec *iov;      // 按文档顺序排列的片段
+    size_t iov_count;
+    size_t iov_cap;
+    int err;                // 0 成功，否则为 errno
+    const char *step;       // 失败的步骤
+}save_job;
+
+static save_job *bg_save = NULL;    // 进行中的后台保存
+static pthread_t save_thread;
+static atomic_int save_done;        // 后台保存线程已结束
+static char message[128] = "";      // 状态栏提示（保存结果），下次按键后清除
+
+static int push_iov(save_job *job, char *base, size_t len)
+{
+    if(job->iov_count == job->iov_cap){
+        size_t cap = job->iov_cap ? job->iov_cap * 2 : 64;
+        struct iovec *iov = (struct iovec *)realloc(job->iov, cap * sizeof(struct iovec));
+        if(iov == NULL) return -1;
+        job->iov = iov;
+        job->iov_cap = cap;
+    }
+    job->iov[job->iov_count].iov_base = base;
+    job->iov[job->iov_count].iov_len = len;
+    job->iov_count++;
+    return 0;
+}
+
+// 中序遍历片段树，每个片段直接引用所在缓冲区
+static int snapshot_pieces(save_job *job, const piece *t)
+{
+    if(t == NULL) return 0;
+    if(snapshot_pieces(job, t->left) == -1) return -1;
+    if(push_iov(job, bufs[t->buf].data + t->start, t->len) == -1) return -1;
+    return snapshot_pieces(job, t->right);
+}
+
+static void free_save_job(save_job *job)
+{
+    free(job->path);
+    free(job->iov);
+    free(job);
+}
+
+// 拍下当前文档的片段快照，末尾附加最后一行的换行
+static save_job *new_save_job(const char *filename)
+{
+    static char newline[] = "\n";
+    save_job *job = (save_job *)calloc(1, sizeof(save_job));
+    if(job == NULL) return NULL;
+    // 符号链接：替换链接指向的文件，而不是用普通文件覆盖链接本身
+    job->path = realpath(filename, NULL);
+    if(job->path == NULL && errno == ENOENT) job->path = strdup(filename);
+    // 最后一行同样以换行结尾
+    if(job->path == NULL || snapshot_pieces(job, root) == -1 || push_iov(job, newline, 1) == -1){
+        free_save_job(job);
+        return NULL;
+    }
+    return job;
+}
+
+// 写出全部 iovec，每次最多 IOV_MAX 个，处理部分写入
+static int writev_all(int fd, struct iovec *iov, size_t count)
+{
+    while(count > 0){
+        ssize_t n = writev(fd, iov, count < IOV_MAX ? (int)count : IOV_MAX);
+        if(n == -1){
+            if(errno == EINTR) continue;
+            return -1;
+        }
+        while(count > 0 && (size_t)n >= iov->iov_len){   // 跳过已写完的片段
+            n -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if(count > 0){      // 片段只写了一部分，从断点继续
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
         }
-        buf[strcspn(buf, "\n")] = '\0'; // 去掉 '\n'
-        // syslog(LOG_INFO,"buf:%s\n",buf);
-        insert_text(line_count, buf);
-        free(buf);
-        line_count++;
     }
-    if(line_count == 0){   // 若为空文本
-        insert_text(0, NULL);
-        line_count = 1;
+    return 0;
+}
+
+// 执行保存，可在任意线程调用（只访问快照）
+static int run_save(save_job *job)
+{
+    size_t name_len = strlen(job->path);
+    char *tmp = (char *)malloc(name_len + sizeof(".XXXXXX"));
+    if(tmp == NULL){
+        job->err = errno;
+        job->step = "malloc";
+        return -1;
+    }
+    memcpy(tmp, job->path, name_len);
+    strcpy(tmp + name_len, ".XXXXXX");
+
+    int fd = mkstemp(tmp);
+    if(fd == -1){
+        job->err = errno;
+        job->step = "mkstemp";
+        free(tmp);
+        return -1;
     }
-    fclose(fp); // 关闭文件描述符
+    // 临时文件继承原文件的属主和权限（mkstemp 创建的文件属于当前用户、权限为 0600）；
+    // 先改属主再改权限，chown 会清除 setuid / setgid 位。原文件的其他硬链接仍指向旧内容
+    struct stat st;
+    if(stat(job->path, &st) == 0){
+        if(fchown(fd, st.st_uid, st.st_gid) == -1)
+            syslog(LOG_WARNING, "fchown %s: %s", job->path, strerror(errno));
+        fchmod(fd, st.st_mode & 07777);
+    }
+
+    job->step = NULL;
+    if(writev_all(fd, job->iov, job->iov_count) == -1) job->step = "writev";
+    else if(fsync(fd) == -1) job->step = "fsync";
+    if(job->step != NULL) job->err = errno;
+    if(close(fd) == -1 && job->step == NULL){
+        job->err = errno;
+        job->step = "close";
+    }
+    if(job->step == NULL && rename(tmp, job->path) == -1){
+        job->err = errno;
+        job->step = "rename";
+    }
+    if(job->step != NULL){
+        unlink(tmp);
+        free(tmp);
+        return -1;
+    }
+    free(tmp);
+
+    // 改名记录在目录中，同步目录后新内容才算完整落盘
+    char *slash = strrchr(job->path, '/');
+    if(slash == job->path) fd = open("/", O_RDONLY | O_DIRECTORY);
+    else if(slash != NULL){
+        *slash = '\0';
+        fd = open(job->path, O_RDONLY | O_DIRECTORY);
+        *slash = '/';
+    }else fd = open(".", O_RDONLY | O_DIRECTORY);
+    if(fd != -1){
+        fsync(fd);
+        close(fd);
+    }
+    return 0;
+}
+
+static void *save_worker(void *arg)
+{
+    run_save((save_job *)arg);
+    atomic_store(&save_done, 1);
+    return NULL;
+}
+
+// 记录保存结果；失败时恢复“有未保存的修改”
+static void report_save(save_job *job)
+{
+    if(job->step == NULL) snprintf(message, sizeof(message), "saved");
+    else{
+        modified = 1;
+        snprintf(message, sizeof(message), "save failed: %s: %s", job->step, strerror(job->err));
+    }
+    free_save_job(job);
+}
+
+// 等待后台保存结束
+static void finish_save(void)
+{
+    if(bg_save == NULL) return;
+    pthread_join(save_thread, NULL);
+    report_save(bg_save);
+    bg_save = NULL;
 }
 
-// 将链表内容写入文件
-static void write_file(char *filename)
+// 在后台线程保存（已有保存进行中时忽略）；无法创建线程时直接保存
+static void save_in_background(const char *filename)
 {
-    line *p = text;
-    FILE *fp = fopen(filename, "w");
-    if(fp == NULL){
-        perror("fopen");
+    if(bg_save != NULL) return;
+    save_job *job = new_save_job(filename);
+    if(job == NULL){
+        snprintf(message, sizeof(message), "save failed: out of memory");
+        return;
+    }
+    modified = 0;   // 快照之后的编辑重新置位
+    atomic_store(&save_done, 0);
+    if(pthread_create(&save_thread, NULL, save_worker, job) != 0){
+        run_save(job);
+        report_save(job);
         return;
     }
-    for(int i=0;i<line_count;++i){
-        fprintf(fp,"%s\n",p->content);    // 也可以用fwrite
-        p = p->next;
+    bg_save = job;
+}
+
+// 在当前线程保存，失败返回 -1 并把原因写入 message
+static int write_file(const char *filename)
+{
+    save_job *job = new_save_job(filename);
+    if(job == NULL){
+        snprintf(message, sizeof(message), "save failed: out of memory");
+        return -1;
+    }
+    modified = 0;
+    int ret = run_save(job);
+    report_save(job);
+    return ret;
+}
+
+/* ---------- 显示 ---------- */
+
+#define TEXT_ROWS (LINES > 1 ? LINES - 1 : 1)  // 文本区行数（最后一行是状态栏）
+
+// 屏幕尺寸变化时重建脏行表并全部重绘
+static void mark_all_dirty(void)
+{
+    if(dirty_rows != TEXT_ROWS){
+        unsigned char *d = (unsigned char *)realloc(dirty, TEXT_ROWS);
+        if(d == NULL) return;
+        dirty = d;
+        dirty_rows = TEXT_ROWS;
+    }
+    memset(dirty, 1, dirty_rows);
+}
+
+// 文档第 row 行内容改变
+static void mark_dirty(size_t row)
+{
+    if(row >= top_row && row - top_row < (size_t)dirty_rows) dirty[row - top_row] = 1;
+}
+
+// 文档第 row 行及其后所有行改变（插入或删除了换行符，后面的行整体移动）
+static void mark_dirty_from(size_t row)
+{
+    if(row < top_row) row = top_row;
+    for(size_t y = row - top_row; y < (size_t)dirty_rows; y++) dirty[y] = 1;
+}
+
+// 调整滚动位置使光标可见，视口移动时整屏重绘
+static void scroll_to_cursor(void)
+{
+    size_t top = top_row, left = left_col;
+    if(current_row < top_row) top_row = current_row;
+    else if(current_row >= top_row + TEXT_ROWS) top_row = current_row - TEXT_ROWS + 1;
+    if(current_col < left_col) left_col = current_col;
+    else if(current_col >= left_col + COLS) left_col = current_col - COLS + 1;
+    if(top != top_row || left != left_col) mark_all_dirty();
+}
+
+// 重绘第 y 个屏幕行
+static void draw_row(int y, char *buf)
+{
+    size_t row = top_row + y;
+    move(y, 0);
+    if(row < doc_lines()){
+        size_t len = line_length(row);
+        if(len > left_col){
+            size_t n = len - left_col < (size_t)COLS ? len - left_col : (size_t)COLS;
+            read_range(root, 0, line_start(row) + left_col, n, buf);
+            addnstr(buf, n);
+        }
+    }
+    clrtoeol();
+}
+
+// 状态栏：文件名、修改标记、行号 / 总行数、列号、保存状态；索引期间显示进度
+static void draw_status(void)
+{
+    char status[256];
+    int n;
+    if(indexing)
+        n = snprintf(status, sizeof(status), " %s  %zu  col %zu  indexing %zu%% ", file_name,
+                     current_row + 1, current_col + 1,
+                     (size_t)(atomic_load(&indexed_bytes) * 100.0 / bufs[BUF_ORIG].len));
+    else
+        n = snprintf(status, sizeof(status), " %s%s  %zu/%zu  col %zu  %s ",
+                     file_name, modified ? " [+]" : "", current_row + 1, doc_lines(), current_col + 1,
+                     bg_save != NULL ? "saving..." : message);
+    attron(A_REVERSE);
+    mvaddnstr(LINES - 1, 0, status, n < COLS ? n : COLS);
+    attroff(A_REVERSE);
+    clrtoeol();
+}
+
+// 索引建立期间直接从映射逐行显示：视口第一行的起点取自已建立的索引，其后各行用 memchr 找
+static void draw_preview(void)
+{
+    const text_buf *b = &bufs[BUF_ORIG];
+    size_t pos = line_start(top_row);
+    for(int y = 0; y < dirty_rows; y++){
+        size_t start = pos, end = pos;
+        if(pos <= orig_doc_len){
+            const char *nl = (const char *)memchr(b->data + pos, '\n', orig_doc_len - pos);
+            end = nl ? (size_t)(nl - b->data) : orig_doc_len;
+            pos = end + 1;
+        }
+        if(!dirty[y]) continue;
+        dirty[y] = 0;
+        move(y, 0);
+        if(end - start > left_col){
+            size_t n = end - start - left_col;
+            addnstr(b->data + start + left_col, n < (size_t)COLS ? n : (size_t)COLS);
+        }
+        clrtoeol();
     }
-    fclose(fp); // 关闭文件描述符
-    // printf_line();
 }
 
-// 显示文本内容
+// 显示文本内容：只重绘脏行
 static void display_text(void)
 {
-    line *p = text;
-    // 清屏 - 直到refresh生效 
-    clear();    // 代替方案 erase() 不会清除窗口的属性设置（如颜色）
-    for(int i = 0; i < line_count; i++){    // 逐行打印文本
-        // 在指定位置打印文本
-        mvprintw(i, 0, "%s", p->content);   // 第i行第0列开始打印
-        p = p->next;
+    if(dirty_rows != TEXT_ROWS) mark_all_dirty();
+    scroll_to_cursor();
+    if(indexing){
+        draw_preview();
+        draw_status();
+        move(current_row - top_row, current_col - left_col);
+        wnoutrefresh(stdscr);
+        doupdate();
+        return;
+    }
+
+    char *buf = (char *)malloc(COLS + 1);
+    if(buf == NULL) return;
+    for(int y = 0; y < dirty_rows; y++){
+        if(!dirty[y]) continue;
+        draw_row(y, buf);
+        dirty[y] = 0;
     }
-    move(current_row, current_col);        // 移动光标到当前行列
-    refresh();  // 刷新窗口显示
-    // printf_line();
+    free(buf);
+    draw_status();
+    move(current_row - top_row, current_col - left_col);    // 移动光标到当前行列
+    wnoutrefresh(stdscr);   // 先更新虚拟屏幕
+    doupdate();             // 再一次性输出到终端
 }
 
 // 插入字符到当前行
 static void insert_char(char ch)
 {
     if((ch<32 && ch!='\n') || ch>126 ) return;
-    line * p = text;
-    int index = current_row;
-    while(index--) {
-        p = p->next;
-    }
-    if(p == NULL)   return;
-
-    if(ch == '\n'){
-        line_count++;
-        // 移动当前行的光标后的内容到新行
-        int move_size = p->length - current_col;
-        char buf[move_size+1];
-        if(move_size > 0){
-            memmove(buf, p->content + current_col, move_size);
-            memset(p->content + current_col, 0, move_size);
-            p->length = current_col;
-        }
-        buf[move_size] = '\0';
-        insert_text(++current_row, buf);
+    if(doc_insert(line_start(current_row) + current_col, &ch, 1) == -1){
+        snprintf(message, sizeof(message), "insert failed");
+        return;
+    }
+    modified = 1;
+    if(ch == '\n'){     // 光标后的内容随换行符成为新行
+        mark_dirty_from(current_row);
+        current_row++;
         current_col = 0;
     }else{
-        if(p->length >= p->capacity){   // 若需要扩展
-            expand_col(p,0);
-        }
-        int move_size = p->length - current_col;
-        memmove(p->content + current_col + 1, p->content + current_col, move_size);
-        p->content[current_col] = ch;
-        p->content[++p->length] = '\0';
-        ++current_col;
+        mark_dirty(current_row);
+        current_col++;
     }
-    display_text(); // 更新显示
 }
 
 // 删除字符
 static void delete_char(void)
 {
-    line * p = text;
-    line * q = NULL;
-    int index = current_row;
-    while(index--) {
-        q = p;
-        p = p->next;
-    }
-    if(p == NULL)   return;
     if(current_col > 0){
-        int move_size = p->length - current_col;
-        memmove(p->content + current_col - 1, p->content + current_col, move_size);
-        p->content[--p->length] = '\0';
+        if(doc_delete(line_start(current_row) + current_col - 1, 1) == -1){
+            snprintf(message, sizeof(message), "delete failed");
+            return;
+        }
+        modified = 1;
+        mark_dirty(current_row);
         current_col--;
-    }else if(current_col==0 && current_row!=0){
-        int len = strlen(p->content);
-        if(len+q->length > q->capacity){
-            expand_col(q, len-(q->capacity-q->length));
+    }else if(current_row != 0){     // 行首退格：删除上一行的换行符，两行合并
+        size_t prev_len = line_length(current_row - 1);
+        if(doc_delete(line_start(current_row) - 1, 1) == -1){
+            snprintf(message, sizeof(message), "delete failed");
+            return;
+        }
+        modified = 1;
+        mark_dirty_from(current_row - 1);
+        current_row--;
+        current_col = prev_len;
+    }
+}
+
+// 索引结束后建立片段树并切换到正常显示；载入失败返回 -1
+static int end_indexing(void)
+{
+    finish_indexing();
+    if(load_failed) return -1;
+    mark_all_dirty();
+    display_text();
+    return 0;
+}
+
+// 等到第 row 行已完整索引（它的换行符已被找到）或索引结束
+static void wait_indexed(size_t row)
+{
+    pthread_mutex_lock(&index_lock);
+    while(bufs[BUF_ORIG].lf_count <= row && !atomic_load(&index_done))
+        pthread_cond_wait(&index_cond, &index_lock);
+    pthread_mutex_unlock(&index_lock);
+}
+
+/*
+ * 索引期间处理按键之前调用：移动光标只等到目标行已被索引（与离开头的距离成正比，而不是整个文件），
+ * 编辑和保存要用片段树，等待索引全部完成。
+ * @return 0 可以处理该键； -1 载入失败
+ */
+static int prepare_key(int ch)
+{
+    size_t row = current_row;
+    switch(ch){
+        case KEY_RESIZE:
+            return 0;
+        case KEY_DOWN:
+            row++;
+            break;
+        case KEY_NPAGE:
+            row += TEXT_ROWS;
+            break;
+        case KEY_UP: case KEY_LEFT: case KEY_RIGHT: case KEY_PPAGE: case KEY_HOME: case KEY_END:
+            break;
+        default:
+            return end_indexing();
+    }
+    wait_indexed(row);
+    return atomic_load(&index_done) ? end_indexing() : 0;
+}
+
+/*
+ * 读取下一个按键。后台索引期间定时醒来刷新进度，索引完成后立即切换到正常显示；
+ * 期间的按键由 prepare_key 决定是否需要等待（Esc 则直接取消索引）。
+ * 后台保存期间同样定时检查保存是否结束。
+ */
+static int next_key(void)
+{
+    while(indexing){
+        timeout(INDEX_POLL_MS);
+        int ch = getch();
+        if(ch == 0x1B){
+            atomic_store(&index_cancel, 1);
+            finish_indexing();
+            return ch;
         }
-        memmove(q->content + q->length,p->content,len+1);
-        delete_text(current_row);
-        q->length+=len;
-        -- current_row;
-        -- line_count;
-        current_col = q->length;
+        if(ch == ERR && atomic_load(&index_done)){
+            if(end_indexing() == -1) return 0x1B;
+            continue;
+        }
+        if(ch != ERR){
+            timeout(-1);
+            return prepare_key(ch) == -1 ? 0x1B : ch;
+        }
+        display_text();     // 只刷新状态栏中的进度
+    }
+    for(;;){    // 后台保存期间定时醒来，保存结束后立即显示结果
+        timeout(bg_save != NULL ? INDEX_POLL_MS : -1);
+        int ch = getch();
+        if(bg_save != NULL && atomic_load(&save_done)){
+            finish_save();
+            display_text();
+        }
+        if(ch != ERR) return ch;
     }
-    display_text(); // 更新显示
 }
 
+#define CTRL_S 0x13
+
 // 处理用户输入
 static void handle_input(void)
 {
     // 输入逻辑
     int ch;
-    while ((ch = getch()) != 0x1B) { // 输入 Esc键 退出
+    while ((ch = next_key()) != 0x1B) { // 输入 Esc键 退出
+        message[0] = '\0';
         switch (ch) {
             case KEY_UP: // 上箭头
-            {
-                if (current_row > 0){
-                    line * p = text;
-                    int index = current_row-1;
-                    while(index--) {
-                        p = p->next;
-                    }
-                    if(p == NULL)   break;
-                    if(current_col > p->length) current_col=p->length;
+                if(current_row > 0){
                     current_row--;
+                    size_t len = line_length(current_row);
+                    if(current_col > len) current_col = len;
                 }
                 break;
-            }
             case KEY_DOWN: // 下箭头
-            {
-                if(current_row < line_count - 1){
-                    line * p = text;
-                    int index = current_row+1;
-                    while(index--) {
-                        p = p->next;
-                    }
-                    if(p == NULL)   break;
-                    if(current_col > p->length) current_col=p->length;
+                if(current_row + 1 < doc_lines()){
                     current_row++;
+                    size_t len = line_length(current_row);
+                    if(current_col > len) current_col = len;
                 }
                 break;
-            }
             case KEY_LEFT: // 左箭头
                 if(current_col > 0) current_col--;
                 break;
             case KEY_RIGHT: // 右箭头
+                if(current_col < line_length(current_row)) current_col++;
+                break;
+            case KEY_PPAGE: // 向上翻页
+            case KEY_NPAGE: // 向下翻页
             {
-                line * p = text;
-                int index = current_row;
-                while(index--) {
-                    p = p->next;
-                }
-                if(p == NULL)   return;
-                if(current_col < p->length) current_col++;
+                size_t page = TEXT_ROWS;
+                if(ch == KEY_PPAGE) current_row = current_row > page ? current_row - page : 0;
+                else current_row = current_row + page < doc_lines() ? current_row + page : doc_lines() - 1;
+                size_t len = line_length(current_row);
+                if(current_col > len) current_col = len;
+                break;
             }
+            case KEY_HOME: // 行首
+                current_col = 0;
+                break;
+            case KEY_END: // 行尾
+                current_col = line_length(current_row);
+                break;
+            case KEY_RESIZE: // 终端尺寸变化
+                mark_all_dirty();
+                break;
+            case CTRL_S: // 后台保存，编辑不中断
+                if(!load_failed) save_in_background(file_name);
                 break;
             case KEY_BACKSPACE: // 后退
                 delete_char();
-                break;                
+                break;
             default:    // 处理普通字符输入
                 insert_char(ch);    // 插入字符
                 break;
         }
-        move(current_row, current_col);
-        refresh();
+        display_text(); // 只重绘变化的行和状态栏
     }
 }
 
@@ -359,19 +1048,32 @@ openlog("ncurses_program", LOG_PID | LOG_CONS, LOG_USER);
     cbreak();               // 终端不再缓冲输入，输入字符立刻传递给程序，可CTRL+C中断
     noecho();               // 不在终端上显示输入的字符
     keypad(stdscr, TRUE);   // 键盘输入支持，允许使用箭头键等特殊键
+    struct termios tio;     // 关闭 XON/XOFF 流控，让 Ctrl+S 传给程序
+    if(tcgetattr(STDIN_FILENO, &tio) == 0){
+        tio.c_iflag &= ~IXON;
+        tcsetattr(STDIN_FILENO, TCSANOW, &tio);
+    }
 
     // 读取文件内容
+    file_name = argv[1];
     read_file(argv[1]);
+    mark_all_dirty();
     display_text(); // 显示文本内容
 
     handle_input(); // 处理键盘输入
 
-    // 保存文件
-    write_file(argv[1]);
+    // 保存文件（未修改或未能载入时不写，避免无谓地重写大文件或清空原文件）
+    finish_save();
+    int save_failed = modified && !load_failed && write_file(argv[1]) == -1;
 
     // 结束 ncurses
     endwin(); // 结束 ncurses 模式
+    if(load_failed && !atomic_load(&index_cancel))
+        fprintf(stderr, "无法载入 %s，文件未修改\n", argv[1]);
+    if(save_failed)
+        fprintf(stderr, "%s %s，原文件未修改\n", argv[1], message);
     free_text();
+    free(dirty);
 closelog();
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
@@ -0,0 +1,63 @@
+#!/bin/bash
+# file_copier 的回归检查：编译到临时目录，逐项比较复制结果
+# 用法：./test_copy.sh
+set -u
+
+dir=$(cd "$(dirname "$0")" && pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+copy="$work/copy"
+gcc -Wall -O2 "$dir/file_copier.c" -o "$copy" -pthread || exit 1
+
+failed=0
+check() {   # check <描述> <命令...>：命令返回非 0 即失败
+    local what=$1
+    shift
+    if "$@"; then
+        echo "ok   $what"
+    else
+        echo "FAIL $what"
+        failed=1
+    fi
+}
+
+printf 'hello\n' > "$work/small.txt"
+head -c 3000000 /dev/urandom > "$work/big.bin"
+
+# 目标为 stdout（管道或重定向的文件）时，输出必须与源逐字节相同，报告行只能出现在 stderr
+for src in small.txt big.bin; do
+    "$copy" "$work/$src" /dev/stdout 2>/dev/null | cat > "$work/out.pipe"
+    check "$src -> /dev/stdout (pipe)" cmp -s "$work/$src" "$work/out.pipe"
+    "$copy" "$work/$src" /dev/stdout > "$work/out.file" 2>/dev/null
+    check "$src -> /dev/stdout (file)" cmp -s "$work/$src" "$work/out.file"
+    "$copy" -v "$work/$src" /dev/stdout 2>/dev/null | cat > "$work/out.pipe"
+    check "-v $src -> /dev/stdout (pipe)" cmp -s "$work/$src" "$work/out.pipe"
+done
+
+# -r 复制到已有目标树：目标处的符号链接被替换，不跟随写到树外
+mkdir -p "$work/src/sub" "$work/dst" "$work/outside"
+printf 'new\n' > "$work/src/a.txt"
+printf 'new\n' > "$work/src/sub/b.txt"
+printf 'keep\n' > "$work/outside/a.txt"
+ln -s "$work/outside/a.txt" "$work/dst/a.txt"
+ln -s "$work/outside" "$work/dst/sub"
+"$copy" -r "$work/src" "$work/dst" 2>/dev/null
+check "-r exit status" test $? -eq 0
+check "-r leaves symlink target alone" grep -qx keep "$work/outside/a.txt"
+check "-r replaces file symlink" test ! -L "$work/dst/a.txt" -a "$(cat "$work/dst/a.txt")" = new
+check "-r replaces directory symlink" test ! -L "$work/dst/sub" -a ! -e "$work/outside/b.txt"
+check "-r copies into replaced directory" cmp -s "$work/src/sub/b.txt" "$work/dst/sub/b.txt"
+
+# -r 重建命名管道；套接字不能复制，计为错误，退出状态非 0
+mkdir -p "$work/special"
+mkfifo -m 640 "$work/special/fifo"
+"$copy" -r -p "$work/special" "$work/special.out" 2>/dev/null
+check "-r exit status with fifo" test $? -eq 0
+check "-r recreates fifo" test -p "$work/special.out/fifo" -a "$(stat -c %a "$work/special.out/fifo")" = 640
+if python3 -c 'import socket, sys; socket.socket(socket.AF_UNIX).bind(sys.argv[1])' "$work/special/sock" 2>/dev/null; then
+    "$copy" -r "$work/special" "$work/special.out2" 2>/dev/null
+    check "-r fails on socket" test $? -ne 0
+    check "-r copies the rest beside a socket" test -p "$work/special.out2/fifo"
+fi
+
+exit $failed
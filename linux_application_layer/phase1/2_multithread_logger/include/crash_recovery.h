@@ -11,10 +11,16 @@ typedef struct{
     void *mapped_addr;
     size_t mapped_size;
     log_buffer_t *log_buffer;
+    bool read_only;         // crash_recovery_open_readonly 打开的只读映射
 }crash_recovery_t;
 
 bool crash_recovery_init(crash_recovery_t *cr, const char *backing_file, size_t size);
 void crash_recovery_cleanup(crash_recovery_t *cr);
 
+/**
+ * @brief 以只读方式映射其他进程正在使用的缓冲文件（不初始化、不修改），用 crash_recovery_cleanup 释放
+ */
+bool crash_recovery_open_readonly(crash_recovery_t *cr, const char *backing_file);
+
 log_buffer_t* crash_recovery_get_buffer(crash_recovery_t *cr);
 bool crash_recovery_flush(crash_recovery_t *cr);
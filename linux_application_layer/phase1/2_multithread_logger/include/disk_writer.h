@@ -1,17 +1,85 @@
 #pragma once
 
+#include <limits.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include "log_buffer.h"
 
 #define DEFAULT_BATCH_SIZE  16
 #define DEFAULT_FLUSH_INTERVAL_MS   1000
+#define DEFAULT_TEXT_LOG_FILE   "persisted_log.txt"     // 文本记录落盘文件
+#define DEFAULT_BINARY_LOG_FILE "persisted_log.bin"     // 结构化记录落盘文件（log_decode 解析）
 
+#define DEFAULT_WRITER_THREADS  2       // 共享写入线程池默认线程数
+#define DISK_WRITER_MAX_THREADS 16
+#define DISK_WRITER_BATCH_BUDGET 4      // 每次被唤醒最多处理的批次数，超出后让出线程给其他日志
+
+// 等待缓冲区空间的生产者（每个事件循环一个），fd 由等待方读取清零
+typedef struct space_waiter{
+    struct space_waiter* next;
+    int fd;                         // eventfd：登记后空闲空间回到 space_watermark 以上时可读
+    bool armed;                     // 已登记等待，通知一次后清除（受 space_lock 保护）
+}space_waiter_t;
+
+// 一个日志实例的落盘端，由共享写入线程池通过 eventfd + epoll 调度
 typedef struct{
-    pthread_t thread;               
-    volatile bool running;
     log_buffer_t* log_buffer;
+    char text_path[PATH_MAX];
+    char binary_path[PATH_MAX];
+    FILE* text_fp;
+    FILE* bin_fp;                   // 首次遇到结构化记录时打开
+    int event_fd;                   // 有数据可写时可读
+    atomic_bool armed;              // 写入线程空闲等待中，生产者需要通过 event_fd 唤醒
+    size_t space_watermark;
+    atomic_int space_armed;         // 已登记等待的 space_waiter 数
+    space_waiter_t* space_waiters;  // 已注册的等待方
+    pthread_mutex_t space_lock;
+    bool closing;
+    bool closed;
+    pthread_mutex_t lock;
+    pthread_cond_t cond_closed;
+    pthread_cond_t cond_drained;    // 每落盘一批广播一次，供 disk_writer_wait_drained 等待
 }disk_writer_t;
 
-bool disk_writer_start(disk_writer_t* writer, log_buffer_t* buffer);
-void disk_writer_stop(disk_writer_t* writer);
\ No newline at end of file
+/**
+ * @brief 设置共享写入线程池的线程数，仅在没有已启动的 disk_writer 时生效
+ */
+bool disk_writer_pool_set_threads(int threads);
+
+/**
+ * @brief 将 buffer 挂到共享写入线程池，首个 writer 启动时创建线程池
+ *
+ * 文本记录追加到 text_path，结构化记录追加到 binary_path（NULL 使用默认文件名）。
+ * space_watermark 为 space_waiter 的唤醒阈值（字节，0 表示 BUFFER_SIZE / 2）。
+ * 启动后会立即排空缓冲区中崩溃前残留的记录。
+ */
+bool disk_writer_start(disk_writer_t* writer, log_buffer_t* buffer,
+                       const char* text_path, const char* binary_path, size_t space_watermark);
+
+/**
+ * @brief 排空缓冲区、关闭文件并从线程池摘除，最后一个 writer 停止时回收线程池
+ */
+void disk_writer_stop(disk_writer_t* writer);
+
+/**
+ * @brief 等待调用时缓冲区中已有的记录全部落盘（包括启动时恢复的残留记录）
+ */
+void disk_writer_wait_drained(disk_writer_t* writer);
+
+/**
+ * @brief 生产者写入记录后调用，仅在写入线程空闲时才触发一次 eventfd 写
+ */
+void disk_writer_notify(disk_writer_t* writer);
+
+/**
+ * @brief 注册 / 注销空间等待方，waiter->fd 由调用方创建和关闭；注销须在 disk_writer_stop 之前
+ */
+void disk_writer_add_waiter(disk_writer_t* writer, space_waiter_t* waiter);
+void disk_writer_remove_waiter(disk_writer_t* writer, space_waiter_t* waiter);
+
+/**
+ * @brief 非阻塞写入返回 EAGAIN 后调用：登记等待，空闲空间回到 space_watermark 以上时向 waiter->fd 通知一次
+ */
+void disk_writer_want_space(disk_writer_t* writer, space_waiter_t* waiter);
@@ -15,17 +15,48 @@
 #include <stdatomic.h>
 
 #define LOG_BUFFER_MAGIC    0x4C4F4742  // 'LOGB'
-#define LOG_BUFFER_VERSION  1
-#define LOG_MESSAGE_MAX_LEN 256         // 单条日志最大长度
-#define BUFFER_SIZE         (1024 * 8)  // 日志条数（环形缓冲容量,必须为 LOG_MESSAGE_MAX_LEN 倍数）
+#define LOG_BUFFER_VERSION  4           // v2: 变长记录；v3: 持久化日志编号与落盘事务；v4: 记录序号
+#define LOG_MESSAGE_MAX_LEN 256         // 单条文本日志最大长度（含编号前缀与换行符）
+#define BUFFER_SIZE         (1024 * 8)  // 环形缓冲容量（字节，必须为 2 的幂）
+
+#define LOG_RECORD_ALIGN        8       // 记录按 8 字节对齐，保证尾部至少能放下一个填充头
+#define LOG_RECORD_MAX_PAYLOAD  1024    // 单条记录负载上限
+
+// 记录类型
+enum {
+    LOG_REC_PAD    = 0,   // 填充：跳到缓冲区起点（记录不跨越缓冲区边界）
+    LOG_REC_TEXT   = 1,   // 文本日志："[id] msg\n"
+    LOG_REC_SCHEMA = 2,   // 结构化日志的 schema 定义（见 log_record.h）
+    LOG_REC_KV     = 3,   // 结构化日志的键值记录（见 log_record.h）
+};
+
+// 记录头，紧跟 len 字节负载，整体按 LOG_RECORD_ALIGN 对齐
+typedef struct{
+    uint16_t len;            // 负载长度（不含记录头）
+    uint8_t  type;           // LOG_REC_*
+    uint8_t  flags;          // 保留
+    uint32_t seq;            // 记录序号，每个缓冲区内连续递增（填充记录为 0），订阅者据此计算错过的记录数
+}log_record_hdr_t;
+
+#define LOG_RECORD_SIZE(len) \
+    ((sizeof(log_record_hdr_t) + (len) + LOG_RECORD_ALIGN - 1) & ~(size_t)(LOG_RECORD_ALIGN - 1))
+
+#define LOG_RING_OFFSET(pos)    ((pos) & (BUFFER_SIZE - 1))     // 自由递增的位置 -> data 内偏移
 
 // 环形缓冲区结构体
 typedef struct{
     uint32_t magic;          // 用于判断是否已经初始化
     uint32_t version;        // 结构版本号
-    atomic_uint head;        // 写指针：下一个写入的位置
-    atomic_uint tail;        // 读指针：下一个读取的位置
-    char data[BUFFER_SIZE];  // 环形缓冲区数据（每条占用 LOG_MESSAGE_MAX_LEN 字节）
+    atomic_uint head;        // 写指针：已写入的总字节数（自由递增，取模 BUFFER_SIZE 得到偏移）
+    atomic_uint tail;        // 读指针：已读取的总字节数
+    atomic_uint next_id;     // 下一条文本日志的编号，随 mmap 持久化，重启后继续递增
+    atomic_uint next_seq;    // 下一条记录的序号
+    // 落盘事务：disk_writer 写出一批记录前登记，tail 推进后清除，崩溃恢复时据此回滚写了一半的批次
+    atomic_uint txn_active;
+    uint32_t txn_tail_end;   // 本批次完成后 tail 的值
+    uint64_t txn_text_off;   // 本批次开始前文本文件的长度
+    uint64_t txn_bin_off;    // 本批次开始前二进制文件的长度
+    char data[BUFFER_SIZE];  // 环形缓冲区数据（由若干条变长记录组成）
     pthread_mutex_t lock;
     pthread_cond_t cond_can_read;
     pthread_cond_t cond_can_write;
@@ -36,7 +67,7 @@ typedef struct{
  * @brief 初始化日志缓冲区
  *
  * 只有当内存区域未被正确初始化（magic 或 version 不匹配）时，才会清空并初始化缓冲区，
- * 如果已初始化，则保留原有数据（实现崩溃后日志恢复）。
+ * 如果已初始化，则保留原有数据（实现崩溃后日志恢复），只重建锁和条件变量。
  *
  * @param buf 待初始化的缓冲区
  * @return int 0 表示已有数据，无需初始化；1 表示做了初始化； -1 表示错误
@@ -52,29 +83,76 @@ void log_buffer_destroy(log_buffer_t* buf);
 /**
  * @brief 向日志缓冲区写入日志
  *
- * 将日志字符串写入缓冲区，如果空间不足则返回 false。写入的每条日志占用 LOG_MESSAGE_MAX_LEN 字节，
- * 格式为日志内容加换行符，不足部分清零。
+ * 将日志字符串加上编号前缀和换行符，作为一条 LOG_REC_TEXT 记录写入缓冲区，
+ * 总长度截断到 LOG_MESSAGE_MAX_LEN - 1 字节。缓冲区满时阻塞等待。
  *
  * @param buf 日志缓冲区
  * @param msg 要写入的日志字符串
- * @return true 成功； false 失败（缓冲区满或参数错误）
+ * @return true 成功； false 失败（参数错误）
  */
 bool log_buffer_write(log_buffer_t* buf, const char* msg);
 
 /**
- * @brief 批量读取日志数据
+ * @brief 非阻塞写入文本日志，缓冲区空间不足时立即返回 false 并置 errno = EAGAIN
+ *
+ * 失败时不会分配日志编号。适用于 epoll 事件循环等不能阻塞的线程。
+ */
+bool log_buffer_try_write(log_buffer_t* buf, const char* msg);
+
+/**
+ * @brief 向日志缓冲区写入一条任意类型的记录
+ *
+ * 记录不会跨越缓冲区末尾：剩余空间不足时先写入一条 LOG_REC_PAD 再从起点写入。
+ * 缓冲区满时阻塞等待。
+ *
+ * @param buf 日志缓冲区
+ * @param type 记录类型（LOG_REC_*，不能为 LOG_REC_PAD）
+ * @param payload 负载
+ * @param len 负载长度，不超过 LOG_RECORD_MAX_PAYLOAD
+ * @return true 成功； false 失败（参数错误）
+ */
+bool log_buffer_write_record(log_buffer_t* buf, uint8_t type, const void* payload, size_t len);
+
+/**
+ * @brief 非阻塞写入记录，缓冲区空间不足时立即返回 false 并置 errno = EAGAIN
+ */
+bool log_buffer_try_write_record(log_buffer_t* buf, uint8_t type, const void* payload, size_t len);
+
+/**
+ * @brief 批量读取日志记录
  *
- * 从环形缓冲区中批量读取日志数据到 out 缓冲区，最多读取 max_len 字节（必须为 LOG_MESSAGE_MAX_LEN 的倍数）。
- * 读取后会更新 tail 指针。
+ * 从环形缓冲区中批量读取完整记录（记录头 + 负载，已跳过填充）到 out 缓冲区，最多读取 max_len 字节。
+ * 调用方可用 log_record_hdr_t 和 LOG_RECORD_SIZE 逐条遍历。读取后会更新 tail 指针。
  *
  * @param buf 日志缓冲区
- * @param out 输出缓冲区
+ * @param out 输出缓冲区（至少能容纳 LOG_RECORD_SIZE(LOG_RECORD_MAX_PAYLOAD) 字节）
  * @param max_len 输出缓冲区大小
  * @return int 返回读取的字节数
  */
 int log_buffer_read_batch(log_buffer_t *buf, char *out, size_t max_len);
 
+/**
+ * @brief 非阻塞批量读取，缓冲区为空时立即返回 0，其余同 log_buffer_read_batch
+ */
+int log_buffer_try_read_batch(log_buffer_t *buf, char *out, size_t max_len);
+
+/**
+ * @brief 非阻塞批量读取但不推进 tail，记录在 log_buffer_consume 前不会被覆盖
+ *
+ * 用于先落盘再释放空间：进程在落盘途中被杀，记录仍留在缓冲区中。
+ *
+ * @param end 输出：这批记录之后的 tail 值，传给 log_buffer_consume
+ * @return int 返回读取的字节数，0 表示缓冲区为空
+ */
+int log_buffer_peek_batch(log_buffer_t *buf, char *out, size_t max_len, uint32_t *end);
+
+/**
+ * @brief 将 tail 推进到 log_buffer_peek_batch 返回的 end，释放空间并唤醒写线程
+ */
+void log_buffer_consume(log_buffer_t *buf, uint32_t end);
+
 // 判断缓冲区操作
 bool log_buffer_is_empty(log_buffer_t* buf);
 bool log_buffer_is_full(log_buffer_t* buf);
+size_t log_buffer_free_space(log_buffer_t* buf);
 uint32_t log_buffer_get_write_fail_count(void);
@@ -0,0 +1,51 @@
+/*
+    * @file log_pending.h
+    * @brief 事件循环的待写日志队列
+    * @details 配合 logger_try_log 使用：缓冲区满时消息暂存在本队列，不阻塞事件循环；
+    * @details 每个队列持有自己的空间等待方（eventfd），只在有消息暂存时登记；
+    * @details fd 可读后由 log_pending_flush 清零并按原顺序补写，水平触发也不会空转。
+    * @details 每个事件循环线程一个队列，队列本身不加锁。
+*/
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "logger.h"
+
+#define LOG_PENDING_DEFAULT_MAX 1024    // 队列默认最多暂存的消息数
+
+typedef struct log_pending log_pending_t;
+
+/**
+ * @brief 创建待写队列
+ * @param max_pending 最多暂存的消息数，0 表示 LOG_PENDING_DEFAULT_MAX，超出后新消息被丢弃
+ */
+log_pending_t* log_pending_create(logger_t* logger, size_t max_pending);
+
+/**
+ * @brief 销毁队列，尚未写出的消息直接释放（调用前可先 log_pending_flush），须在 logger_close 之前调用
+ */
+void log_pending_destroy(log_pending_t* pending);
+
+/**
+ * @brief 写入一条日志，从不阻塞
+ *
+ * 队列为空时直接尝试写入缓冲区；缓冲区满或队列中已有消息时（保证顺序）复制到队列末尾。
+ *
+ * @return true 已写入或已入队； false 队列已满，消息被丢弃
+ */
+bool log_pending_log(log_pending_t* pending, const char* msg);
+
+/**
+ * @brief 空间就绪 fd 可读后调用：清零 fd，按顺序补写暂存的消息，直到写完或再次 EAGAIN（重新登记）
+ * @return size_t 仍在队列中的消息数
+ */
+size_t log_pending_flush(log_pending_t* pending);
+
+/**
+ * @brief 需要注册到 epoll / poll 的 fd（EPOLLIN，水平或边沿触发均可）
+ */
+int log_pending_fd(log_pending_t* pending);
+
+size_t log_pending_count(log_pending_t* pending);
+size_t log_pending_dropped(log_pending_t* pending);
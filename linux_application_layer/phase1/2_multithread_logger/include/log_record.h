@@ -0,0 +1,91 @@
+/*
+    * @file log_record.h
+    * @brief 结构化日志记录的编码与解码
+    * @details 调用方先注册 schema（字段名和类型），之后只记录类型化的值。
+    * @details 值以紧凑二进制（varint / 定长浮点 / 带长度字符串）存放在环形缓冲区与落盘文件中，
+    * @details 下游由 log_decode 渲染为文本或 JSON 行，无需再用正则解析。
+*/
+#pragma once
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define LOG_SCHEMA_MAX          64      // 最多可注册的 schema 数
+#define LOG_SCHEMA_MAX_FIELDS   16      // 每个 schema 最多字段数
+#define LOG_NAME_MAX_LEN        31      // schema 名 / 字段名最大长度
+
+#define LOG_BIN_FILE_MAGIC      "LOGKV\0\0\3"   // 二进制落盘文件头（8 字节），末字节随记录头格式变化
+#define LOG_BIN_FILE_MAGIC_LEN  8
+
+// 字段类型
+typedef enum{
+    LOG_FIELD_I64  = 1,     // int64_t，zigzag varint 编码
+    LOG_FIELD_U64  = 2,     // uint64_t，varint 编码
+    LOG_FIELD_F64  = 3,     // double，8 字节小端
+    LOG_FIELD_STR  = 4,     // const char*，varint 长度 + 字节
+    LOG_FIELD_BOOL = 5,     // int（变参提升），1 字节
+}log_field_type_t;
+
+// 注册 schema 时使用的字段描述
+typedef struct{
+    const char *name;
+    log_field_type_t type;
+}log_field_def_t;
+
+typedef struct{
+    uint16_t id;
+    uint8_t  field_count;
+    uint8_t  field_types[LOG_SCHEMA_MAX_FIELDS];
+    char     name[LOG_NAME_MAX_LEN + 1];
+    char     field_names[LOG_SCHEMA_MAX_FIELDS][LOG_NAME_MAX_LEN + 1];
+}log_schema_t;
+
+// 输出格式
+typedef enum{
+    LOG_FORMAT_TEXT,        // ts schema key=value ...
+    LOG_FORMAT_JSON,        // {"ts":...,"schema":...,"key":value,...}
+}log_format_t;
+
+/**
+ * @brief 根据字段描述填充 schema
+ * @return true 成功； false 名称过长、字段过多或类型非法
+ */
+bool log_schema_init(log_schema_t *schema, uint16_t id, const char *name,
+                     const log_field_def_t *fields, size_t field_count);
+
+/**
+ * @brief 将 schema 编码为 LOG_REC_SCHEMA 记录负载
+ * @return int 负载长度； -1 表示 out 空间不足
+ */
+int log_schema_encode(const log_schema_t *schema, uint8_t *out, size_t cap);
+
+/**
+ * @brief 从 LOG_REC_SCHEMA 记录负载解码 schema
+ */
+bool log_schema_decode(log_schema_t *schema, const uint8_t *in, size_t len);
+
+/**
+ * @brief 将一组类型化的值编码为 LOG_REC_KV 记录负载
+ *
+ * 负载格式：schema id（2 字节）+ 时间戳（8 字节，纳秒）+ 按 schema 顺序排列的字段值。
+ * 变参类型必须与 schema 一致：I64 传 int64_t，U64 传 uint64_t，F64 传 double，
+ * STR 传 const char*（NULL 按空串处理），BOOL 传 int。
+ *
+ * @return int 负载长度； -1 表示 out 空间不足
+ */
+int log_kv_encode(const log_schema_t *schema, uint64_t ts_ns, uint8_t *out, size_t cap, va_list ap);
+
+/**
+ * @brief 读取 LOG_REC_KV 负载中的 schema id
+ * @return int schema id； -1 表示负载非法
+ */
+int log_kv_schema_id(const uint8_t *in, size_t len);
+
+/**
+ * @brief 将 LOG_REC_KV 负载按 schema 渲染为一行文本或 JSON（含换行符）
+ * @return int 写入 out 的字节数（不含结尾 '\0'）； -1 表示负载与 schema 不匹配或 out 空间不足
+ */
+int log_kv_format(const log_schema_t *schema, const uint8_t *in, size_t len,
+                  log_format_t format, char *out, size_t cap);
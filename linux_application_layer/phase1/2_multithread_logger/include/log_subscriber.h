@@ -0,0 +1,53 @@
+/*
+    * @file log_subscriber.h
+    * @brief 环形缓冲区的只读订阅游标
+    * @details 订阅者无锁读取已发布的记录，不占用缓冲区空间，也不会拖慢 disk_writer；
+    * @details 落后太多（记录已被覆盖）时自动跳到最旧的有效记录，并通过记录序号报告错过的条数。
+    * @details 同一机制适用于同进程（logger_subscribe）和以只读方式映射 log_buffer.mmap 的其他进程（log_subscriber_open）。
+*/
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "log_buffer.h"
+#include "crash_recovery.h"
+
+typedef struct{
+    const log_buffer_t* buf;
+    uint32_t pos;           // 下一条记录的位置
+    uint32_t next_seq;      // 期望的下一条记录序号，挂上时确定
+    uint64_t missed;        // 累计错过的记录数
+    crash_recovery_t cr;    // log_subscriber_open 打开的只读映射
+}log_subscriber_t;
+
+/**
+ * @brief 在同进程的缓冲区上挂一个订阅游标
+ * @param from_oldest true 从缓冲区中尚未落盘的最旧记录开始； false 只接收之后发布的记录
+ */
+void log_subscriber_attach(log_subscriber_t* sub, const log_buffer_t* buf, bool from_oldest);
+
+/**
+ * @brief 以只读方式映射其他进程的 mmap 缓冲文件并挂上游标，用 log_subscriber_close 释放
+ */
+bool log_subscriber_open(log_subscriber_t* sub, const char* backing_file, bool from_oldest);
+void log_subscriber_close(log_subscriber_t* sub);
+
+/**
+ * @brief 非阻塞读取下一条已发布的记录（跳过填充）
+ *
+ * @param hdr 输出：记录头
+ * @param payload 输出：负载，cap 至少为 LOG_RECORD_MAX_PAYLOAD
+ * @param missed 输出（可为 NULL）：本条记录之前错过的记录数（错过的记录在读到其后的下一条记录时才能确定）
+ * @return int 1 读到记录； 0 暂无新记录
+ */
+int log_subscriber_read(log_subscriber_t* sub, log_record_hdr_t* hdr, void* payload, size_t cap, uint32_t* missed);
+
+/**
+ * @brief 等待新记录发布，最多 timeout_ms 毫秒（< 0 表示一直等）
+ *
+ * 只读映射的订阅者无法参与写端的同步，这里以 1ms 间隔轮询 head。
+ *
+ * @return true 有新记录； false 超时
+ */
+bool log_subscriber_wait(log_subscriber_t* sub, int timeout_ms);
@@ -3,11 +3,112 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include "log_record.h"
+#include "log_subscriber.h"
 
+typedef struct logger logger_t;
+
+// 日志实例配置，字段为 NULL / 0 时使用默认值
+typedef struct{
+    const char* backing_file;   // mmap 缓冲文件，默认 DEFAULT_BACKING_FILE
+    size_t buffer_size;         // mmap 文件大小
+    const char* text_path;      // 文本日志落盘文件，默认 DEFAULT_TEXT_LOG_FILE
+    const char* binary_path;    // 结构化日志落盘文件，默认 DEFAULT_BINARY_LOG_FILE
+    size_t space_watermark;     // logger_space_fd 的唤醒阈值（空闲字节数），默认 BUFFER_SIZE / 2
+}logger_config_t;
+
+/**
+ * @brief 打开一个独立的日志实例（独立的环形缓冲、mmap 文件与输出文件）
+ *
+ * 所有实例共享一个小型写入线程池，见 logger_set_writer_threads。
+ * 不同实例不能使用相同的 backing_file 或输出文件。
+ *
+ * @return logger_t* 实例句柄； NULL 表示失败
+ */
+logger_t* logger_open(const logger_config_t* config);
+
+/**
+ * @brief 排空并关闭日志实例，调用前需保证没有线程仍在写入该实例
+ */
+void logger_close(logger_t* logger);
+
+bool logger_log(logger_t* logger, const char* msg);
+bool logger_sync(logger_t* logger);
+
+/**
+ * @brief 阻塞直到调用前写入缓冲区的记录（以及启动时恢复的残留记录）全部落盘
+ */
+bool logger_drain(logger_t* logger);
+
+/**
+ * @brief 非阻塞写入，供 epoll 事件循环使用
+ *
+ * 缓冲区满时立即返回 false 并置 errno = EAGAIN。需要在空间就绪时得到通知的调用方
+ * 随后对自己的 log_space_waiter_t 调用 logger_space_waiter_arm。
+ */
+bool logger_try_log(logger_t* logger, const char* msg);
+
+typedef struct log_space_waiter log_space_waiter_t;
+
+/**
+ * @brief 创建空间等待方（每个事件循环一个），持有一个独立的非阻塞 eventfd
+ *
+ * 须在 logger_close 之前用 logger_space_waiter_close 释放。
+ */
+log_space_waiter_t* logger_space_waiter_open(logger_t* logger);
+void logger_space_waiter_close(log_space_waiter_t* waiter);
+
+/**
+ * @brief 等待方的 eventfd，可用水平触发或边沿触发注册到 epoll / poll
+ *
+ * 每次 logger_space_waiter_arm 之后，空闲空间回到 space_watermark 以上时变为可读，
+ * 并保持可读直到调用方 read（eventfd_read）清零；未登记时不会变为可读。fd 归等待方所有，不要关闭。
+ */
+int logger_space_waiter_fd(log_space_waiter_t* waiter);
+
+/**
+ * @brief 非阻塞写入返回 EAGAIN 后调用，登记一次空间就绪通知
+ */
+void logger_space_waiter_arm(log_space_waiter_t* waiter);
+
+/**
+ * @brief 注册结构化日志 schema
+ *
+ * 同名 schema 重复注册时返回已有 id。schema 定义会作为一条记录写入缓冲区，
+ * 随后落盘到二进制日志文件，供 log_decode 解析之后的键值记录。
+ *
+ * @return int schema id（>= 1）； -1 表示失败
+ */
+int logger_add_schema(logger_t* logger, const char* name, const log_field_def_t* fields, size_t field_count);
+
+/**
+ * @brief 按 schema 写入一条结构化日志，变参类型约定见 log_kv_encode
+ */
+bool logger_log_kv(logger_t* logger, int schema_id, ...);
+
+/**
+ * @brief logger_log_kv 的非阻塞版本，失败语义同 logger_try_log
+ */
+bool logger_try_log_kv(logger_t* logger, int schema_id, ...);
+
+/**
+ * @brief 在实例的环形缓冲上挂一个只读订阅游标（读取方式见 log_subscriber.h），不影响落盘
+ */
+bool logger_subscribe(logger_t* logger, log_subscriber_t* sub, bool from_oldest);
+
+/**
+ * @brief 设置共享写入线程池的线程数（默认 DEFAULT_WRITER_THREADS），需在打开第一个实例前调用
+ */
+bool logger_set_writer_threads(int threads);
+
+// 默认实例：输出到 persisted_log.txt / persisted_log.bin
 bool logger_init(const char* filepath, size_t buffer_size);
 void logger_shutdown(void);
 bool logger_write(const char* msg);
 bool logger_flush(void);
+bool logger_drain_default(void);
+int logger_register_schema(const char* name, const log_field_def_t* fields, size_t field_count);
+bool logger_write_kv(int schema_id, ...);
 
 
-#endif
\ No newline at end of file
+#endif
@@ -14,11 +14,14 @@
 #include <stdio.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include "../include/crash_recovery.h"
 #include "sys/types.h"
 
 
+_Static_assert(sizeof(log_buffer_t) <= BUFFER_SIZE + LOG_MESSAGE_MAX_LEN, "默认映射大小放不下 log_buffer_t");
+
 bool crash_recovery_init(crash_recovery_t *cr, const char *filepath, size_t size)
 {
     if (!cr) return false;
@@ -45,25 +48,59 @@ bool crash_recovery_init(crash_recovery_t *cr, const char *filepath, size_t size
 
     cr->mapped_size = size;
     cr->log_buffer = (log_buffer_t*)cr->mapped_addr;
+    cr->read_only = false;
 
-    // 如果不是有效的日志缓冲区，进行初始化
-    if (cr->log_buffer->magic != LOG_BUFFER_MAGIC || cr->log_buffer->version != LOG_BUFFER_VERSION) {
+    // 如果不是有效的日志缓冲区，进行初始化；否则保留数据并重建锁
+    if (log_buffer_init(cr->log_buffer) == 1) {
         printf("日志缓冲区初始化\n");
-        log_buffer_init(cr->log_buffer);
-        // 写入新初始化的魔数和版本号
-        cr->log_buffer->magic = LOG_BUFFER_MAGIC;
-        cr->log_buffer->version = LOG_BUFFER_VERSION;
         // 强制刷新到磁盘
         msync(cr->mapped_addr, cr->mapped_size, MS_SYNC);
     }
     return true;
 }
 
+bool crash_recovery_open_readonly(crash_recovery_t *cr, const char *filepath)
+{
+    if (!cr) return false;
+    if (!filepath) filepath = DEFAULT_BACKING_FILE;
+    cr->mapped_addr = NULL;
+    cr->log_buffer = NULL;
+    cr->mapped_size = 0;
+    cr->read_only = true;
+
+    cr->fd = open(filepath, O_RDONLY);
+    if (cr->fd < 0){perror("{crash_recovery_open_readonly}open"); return false;}
+
+    struct stat st;
+    if (fstat(cr->fd, &st) != 0 || (size_t)st.st_size < sizeof(log_buffer_t)) {
+        fprintf(stderr, "{crash_recovery_open_readonly}%s: not a log buffer\n", filepath);
+        close(cr->fd);
+        cr->fd = -1;
+        return false;
+    }
+    cr->mapped_addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, cr->fd, 0);
+    if (cr->mapped_addr == MAP_FAILED) {
+        perror("{crash_recovery_open_readonly}mmap");
+        close(cr->fd);
+        cr->fd = -1;
+        cr->mapped_addr = NULL;
+        return false;
+    }
+    cr->mapped_size = st.st_size;
+    cr->log_buffer = (log_buffer_t*)cr->mapped_addr;
+    if (cr->log_buffer->magic != LOG_BUFFER_MAGIC || cr->log_buffer->version != LOG_BUFFER_VERSION) {
+        fprintf(stderr, "{crash_recovery_open_readonly}%s: not a log buffer\n", filepath);
+        crash_recovery_cleanup(cr);
+        return false;
+    }
+    return true;
+}
+
 void crash_recovery_cleanup(crash_recovery_t *cr)
 {
     if (!cr) return;
     if (cr->mapped_addr && cr->mapped_size) {
-        msync(cr->mapped_addr, cr->mapped_size, MS_SYNC);
+        if (!cr->read_only) msync(cr->mapped_addr, cr->mapped_size, MS_SYNC);
         munmap(cr->mapped_addr, cr->mapped_size);
     }
     if (cr->fd >= 0) close(cr->fd);
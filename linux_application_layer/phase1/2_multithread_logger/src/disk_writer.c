@@ -1,64 +1,428 @@
 /**
     @file disk_writer.c
     @brief 磁盘写入器实现
-    @details 单独线程定期从 log_buffer 中批量读取日志并写入文件
-    @details 支持配置批处理大小和刷新间隔
+    @details 一个小型共享线程池服务所有日志实例：每个实例一个 eventfd，注册到同一个 epoll
+    @details 使用 EPOLLONESHOT 保证同一实例同时只有一个线程在写，文件内记录顺序不变
+    @details 每次唤醒最多处理 DISK_WRITER_BATCH_BUDGET 批，繁忙的日志不会阻塞其他日志
+    @details 文本记录写入 text_path，schema / 键值记录原样写入 binary_path
+    @details binary_path 已存在但文件头与当前格式不符时，启动时改名留存，不与新格式记录混写
     @details 支持优雅关闭（graceful shutdown）
 */
+#include <errno.h>
 #include <pthread.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
 #include <time.h>
 #include <unistd.h>
 #include "../include/disk_writer.h"
+#include "../include/log_record.h"
 
-static void* disk_writer_thread(void *arg)
+static struct{
+    pthread_mutex_t lock;
+    int epoll_fd;
+    int stop_fd;                // 线程池退出通知，不设 ONESHOT，所有线程都能看到
+    int users;                  // 已挂载的 writer 数
+    int thread_count;
+    pthread_t threads[DISK_WRITER_MAX_THREADS];
+}g_pool = { PTHREAD_MUTEX_INITIALIZER, -1, -1, 0, DEFAULT_WRITER_THREADS, {0} };
+
+// 首次遇到结构化记录时才打开二进制文件，空文件先写入文件头
+static FILE* open_binary_log(const char* path)
 {
-    disk_writer_t* writer = (disk_writer_t*)arg;
-    char batch[BUFFER_SIZE]; // 临时缓冲区
-    FILE* fp = fopen("persisted_log.txt", "a");
+    FILE* fp = fopen(path, "ab");
     if (!fp) {
         perror("fopen");
         return NULL;
     }
-    while (writer->running) {
-        memset(batch, 0, BUFFER_SIZE);
-        int bytes = log_buffer_read_batch(writer->log_buffer, batch, sizeof(batch));
-        if (bytes > 0) {
-            for (int i = 0; i < bytes; i += LOG_MESSAGE_MAX_LEN) {
-                int len = strnlen(batch + i, LOG_MESSAGE_MAX_LEN);
-                if (len > 0) {
-                    size_t written = fwrite(batch + i, 1, len, fp);
-                    if (written != (size_t)len) {
-                        perror("fwrite");
-                    }
-                }
-            }
-            fflush(fp);
-            fsync(fileno(fp));
-        }
+    if (ftell(fp) == 0 && fwrite(LOG_BIN_FILE_MAGIC, 1, LOG_BIN_FILE_MAGIC_LEN, fp) != LOG_BIN_FILE_MAGIC_LEN) {
+        perror("fwrite");
+    }
+    return fp;
+}
+
+// 启动时调用：已有的非空二进制文件若不是当前格式（升级前写入的旧记录头），改名留存，之后写入新文件
+static void rotate_stale_binary_log(const char* path)
+{
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return;
+    char magic[LOG_BIN_FILE_MAGIC_LEN];
+    size_t n = fread(magic, 1, sizeof(magic), fp);
+    fclose(fp);
+    if (n == 0 || (n == sizeof(magic) && memcmp(magic, LOG_BIN_FILE_MAGIC, sizeof(magic)) == 0)) return;
+
+    char old_path[PATH_MAX + 32];
+    snprintf(old_path, sizeof(old_path), "%s.%ld.old", path, (long)time(NULL));
+    if (rename(path, old_path) != 0) {
+        perror("{disk_writer}rename");
+        return;
     }
+    fprintf(stderr, "{disk_writer}%s 的格式与当前版本不符，已改名为 %s\n", path, old_path);
+}
+
+static void sync_file(FILE* fp)
+{
+    if (!fp) return;
     fflush(fp);
     fsync(fileno(fp));
-    fclose(fp);
+}
+
+static void write_batch(disk_writer_t* writer, const char* batch, int bytes)
+{
+    bool text_dirty = false, bin_dirty = false;
+    for (int i = 0; i < bytes; ) {
+        log_record_hdr_t hdr;
+        memcpy(&hdr, batch + i, sizeof(hdr));
+        size_t rec_size = LOG_RECORD_SIZE(hdr.len);
+        if (hdr.type == LOG_REC_TEXT) {
+            if (fwrite(batch + i + sizeof(hdr), 1, hdr.len, writer->text_fp) != hdr.len)
+                perror("fwrite");
+            text_dirty = true;
+        } else if (hdr.type == LOG_REC_SCHEMA || hdr.type == LOG_REC_KV) {
+            if (!writer->bin_fp) writer->bin_fp = open_binary_log(writer->binary_path);
+            // 落盘格式与缓冲区一致：记录头 + 负载（不含对齐填充）
+            if (writer->bin_fp && fwrite(batch + i, 1, sizeof(hdr) + hdr.len, writer->bin_fp) != sizeof(hdr) + hdr.len)
+                perror("fwrite");
+            bin_dirty = true;
+        }
+        i += rec_size;
+    }
+    if (text_dirty) sync_file(writer->text_fp);
+    if (bin_dirty) sync_file(writer->bin_fp);
+}
+
+// 空闲空间达到水位时通知所有已登记的等待方，每次登记只通知一次
+static void signal_space(disk_writer_t* writer)
+{
+    if (atomic_load(&writer->space_armed) == 0 ||
+        log_buffer_free_space(writer->log_buffer) < writer->space_watermark)
+        return;
+    pthread_mutex_lock(&writer->space_lock);
+    for (space_waiter_t* w = writer->space_waiters; w; w = w->next) {
+        if (!w->armed) continue;
+        w->armed = false;
+        atomic_fetch_sub(&writer->space_armed, 1);
+        if (eventfd_write(w->fd, 1) != 0)
+            perror("eventfd_write");
+    }
+    pthread_mutex_unlock(&writer->space_lock);
+}
+
+static uint64_t file_size(const char* path, FILE* fp)
+{
+    struct stat st;
+    if (fp) {
+        fflush(fp);
+        return fstat(fileno(fp), &st) == 0 ? (uint64_t)st.st_size : 0;
+    }
+    return stat(path, &st) == 0 ? (uint64_t)st.st_size : 0;
+}
+
+// 落盘事务：先登记批次开始前两个文件的长度，写完并 fsync 后再推进 tail
+static void txn_begin(disk_writer_t* writer, uint32_t end)
+{
+    log_buffer_t* buf = writer->log_buffer;
+    buf->txn_text_off = file_size(writer->text_path, writer->text_fp);
+    buf->txn_bin_off = file_size(writer->binary_path, writer->bin_fp);
+    buf->txn_tail_end = end;
+    atomic_store(&buf->txn_active, 1);
+}
+
+static void txn_commit(disk_writer_t* writer, uint32_t end)
+{
+    log_buffer_consume(writer->log_buffer, end);
+    atomic_store(&writer->log_buffer->txn_active, 0);
+}
+
+static void truncate_to(const char* path, uint64_t size)
+{
+    struct stat st;
+    // 只截短，文件被外部删除或轮转后不要补零扩展
+    if (stat(path, &st) == 0 && (uint64_t)st.st_size > size && truncate(path, size) != 0)
+        perror("{disk_writer}truncate");
+}
+
+// 启动时调用：上次进程在落盘途中被杀，tail 未推进说明这批记录仍在缓冲区中，
+// 回滚文件中已写入的部分（可能是半行），随后整批重写，既不丢失也不重复
+static void txn_recover(disk_writer_t* writer)
+{
+    log_buffer_t* buf = writer->log_buffer;
+    if (!atomic_load(&buf->txn_active)) return;
+    if (atomic_load(&buf->tail) != buf->txn_tail_end) {
+        truncate_to(writer->text_path, buf->txn_text_off);
+        truncate_to(writer->binary_path, buf->txn_bin_off);
+    }
+    atomic_store(&buf->txn_active, 0);
+}
+
+// 最多处理 budget 批（budget < 0 表示直到为空），返回缓冲区是否已排空
+static bool drain(disk_writer_t* writer, int budget)
+{
+    char batch[BUFFER_SIZE]; // 临时缓冲区
+    while (budget < 0 || budget-- > 0) {
+        uint32_t end;
+        int bytes = log_buffer_peek_batch(writer->log_buffer, batch, sizeof(batch), &end);
+        if (bytes <= 0) return true;
+        txn_begin(writer, end);
+        write_batch(writer, batch, bytes);
+        txn_commit(writer, end);
+        pthread_cond_broadcast(&writer->cond_drained);
+        signal_space(writer);
+    }
+    return log_buffer_is_empty(writer->log_buffer);
+}
+
+static void wake(disk_writer_t* writer)
+{
+    if (eventfd_write(writer->event_fd, 1) != 0)
+        perror("eventfd_write");
+}
+
+static void handle_writer(disk_writer_t* writer)
+{
+    eventfd_t count;
+    eventfd_read(writer->event_fd, &count);    // 非阻塞，清零计数
+
+    pthread_mutex_lock(&writer->lock);
+    if (writer->closing) {
+        drain(writer, -1);
+        epoll_ctl(g_pool.epoll_fd, EPOLL_CTL_DEL, writer->event_fd, NULL);
+        writer->closed = true;
+        pthread_cond_broadcast(&writer->cond_closed);
+        pthread_mutex_unlock(&writer->lock);
+        return;     // 之后不能再访问 writer
+    }
+    bool empty = drain(writer, DISK_WRITER_BATCH_BUDGET);
+    pthread_mutex_unlock(&writer->lock);
+
+    if (!empty) {
+        wake(writer);   // 还有数据：重新排队，先让其他日志被处理
+    } else {
+        // 先置位再复查，避免与生产者的 notify 交错时丢失唤醒
+        atomic_store(&writer->armed, true);
+        if (!log_buffer_is_empty(writer->log_buffer) && atomic_exchange(&writer->armed, false))
+            wake(writer);
+    }
+
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLONESHOT, .data.ptr = writer };
+    if (epoll_ctl(g_pool.epoll_fd, EPOLL_CTL_MOD, writer->event_fd, &ev) != 0)
+        perror("epoll_ctl");
+}
+
+static void* disk_writer_thread(void *arg)
+{
+    (void)arg;
+    for (;;) {
+        struct epoll_event ev;
+        // 每次只取一个事件，避免一个线程囤积多个日志
+        int n = epoll_wait(g_pool.epoll_fd, &ev, 1, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+        if (n == 0) continue;
+        if (ev.data.ptr == NULL) break;     // stop_fd
+        handle_writer((disk_writer_t*)ev.data.ptr);
+    }
     return NULL;
 }
 
-bool disk_writer_start(disk_writer_t* writer, log_buffer_t* buffer)
+bool disk_writer_pool_set_threads(int threads)
+{
+    if (threads < 1 || threads > DISK_WRITER_MAX_THREADS) return false;
+    pthread_mutex_lock(&g_pool.lock);
+    bool ok = (g_pool.users == 0);
+    if (ok) g_pool.thread_count = threads;
+    pthread_mutex_unlock(&g_pool.lock);
+    return ok;
+}
+
+static void pool_teardown(int started)
+{
+    if (g_pool.stop_fd >= 0) eventfd_write(g_pool.stop_fd, 1);
+    for (int i = 0; i < started; i++) pthread_join(g_pool.threads[i], NULL);
+    if (g_pool.stop_fd >= 0) close(g_pool.stop_fd);
+    if (g_pool.epoll_fd >= 0) close(g_pool.epoll_fd);
+    g_pool.stop_fd = g_pool.epoll_fd = -1;
+}
+
+// 需持有 g_pool.lock
+static bool pool_acquire(void)
+{
+    if (g_pool.users++ > 0) return true;
+
+    g_pool.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    g_pool.stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+    if (g_pool.epoll_fd < 0 || g_pool.stop_fd < 0 ||
+        epoll_ctl(g_pool.epoll_fd, EPOLL_CTL_ADD, g_pool.stop_fd, &ev) != 0) {
+        perror("{disk_writer}epoll");
+        pool_teardown(0);
+        g_pool.users = 0;
+        return false;
+    }
+    for (int i = 0; i < g_pool.thread_count; i++) {
+        if (pthread_create(&g_pool.threads[i], NULL, disk_writer_thread, NULL) != 0) {
+            perror("{disk_writer}pthread_create");
+            pool_teardown(i);
+            g_pool.users = 0;
+            return false;
+        }
+    }
+    return true;
+}
+
+// 需持有 g_pool.lock
+static void pool_release(void)
+{
+    if (--g_pool.users > 0) return;
+    pool_teardown(g_pool.thread_count);
+}
+
+bool disk_writer_start(disk_writer_t* writer, log_buffer_t* buffer,
+                       const char* text_path, const char* binary_path, size_t space_watermark)
 {
     if (!writer || !buffer) return false;
+    memset(writer, 0, sizeof(*writer));
     writer->log_buffer = buffer;
-    writer->running = true;
-    return pthread_create(&writer->thread, NULL, disk_writer_thread, writer) == 0;
+    snprintf(writer->text_path, sizeof(writer->text_path), "%s", text_path ? text_path : DEFAULT_TEXT_LOG_FILE);
+    snprintf(writer->binary_path, sizeof(writer->binary_path), "%s", binary_path ? binary_path : DEFAULT_BINARY_LOG_FILE);
+
+    txn_recover(writer);
+    rotate_stale_binary_log(writer->binary_path);
+    writer->text_fp = fopen(writer->text_path, "a");
+    if (!writer->text_fp) {
+        perror("fopen");
+        return false;
+    }
+    writer->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (writer->event_fd < 0) {
+        perror("eventfd");
+        fclose(writer->text_fp);
+        return false;
+    }
+    writer->space_watermark = (space_watermark && space_watermark <= BUFFER_SIZE) ? space_watermark : BUFFER_SIZE / 2;
+    atomic_store(&writer->space_armed, 0);
+    writer->space_waiters = NULL;
+    pthread_mutex_init(&writer->space_lock, NULL);
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->cond_closed, NULL);
+    pthread_cond_init(&writer->cond_drained, NULL);
+    atomic_store(&writer->armed, false);
+
+    pthread_mutex_lock(&g_pool.lock);
+    bool ok = pool_acquire();
+    if (ok) {
+        // 初始计数为 1：注册后立即被调度一次，排空崩溃前残留的记录
+        struct epoll_event ev = { .events = EPOLLIN | EPOLLONESHOT, .data.ptr = writer };
+        eventfd_write(writer->event_fd, 1);
+        if (epoll_ctl(g_pool.epoll_fd, EPOLL_CTL_ADD, writer->event_fd, &ev) != 0) {
+            perror("epoll_ctl");
+            pool_release();
+            ok = false;
+        }
+    }
+    pthread_mutex_unlock(&g_pool.lock);
+
+    if (!ok) {
+        close(writer->event_fd);
+        fclose(writer->text_fp);
+        pthread_cond_destroy(&writer->cond_closed);
+        pthread_cond_destroy(&writer->cond_drained);
+        pthread_mutex_destroy(&writer->lock);
+        pthread_mutex_destroy(&writer->space_lock);
+    }
+    return ok;
 }
 
 void disk_writer_stop(disk_writer_t* writer)
 {
-    if (!writer) return;
-    writer->running = false;
-    pthread_cond_broadcast(&writer->log_buffer->cond_can_read); // 唤醒以至于能退出
-    pthread_join(writer->thread, NULL);
-}
\ No newline at end of file
+    if (!writer || !writer->text_fp) return;
+
+    // 交给线程池完成最后的排空与摘除，保证不与正在进行的批次并发
+    pthread_mutex_lock(&writer->lock);
+    writer->closing = true;
+    pthread_mutex_unlock(&writer->lock);
+    wake(writer);
+
+    pthread_mutex_lock(&writer->lock);
+    while (!writer->closed)
+        pthread_cond_wait(&writer->cond_closed, &writer->lock);
+    pthread_mutex_unlock(&writer->lock);
+
+    sync_file(writer->text_fp);
+    fclose(writer->text_fp);
+    if (writer->bin_fp) {
+        sync_file(writer->bin_fp);
+        fclose(writer->bin_fp);
+    }
+    close(writer->event_fd);
+    pthread_cond_destroy(&writer->cond_closed);
+    pthread_cond_destroy(&writer->cond_drained);
+    pthread_mutex_destroy(&writer->lock);
+    pthread_mutex_destroy(&writer->space_lock);
+    writer->text_fp = writer->bin_fp = NULL;
+
+    pthread_mutex_lock(&g_pool.lock);
+    pool_release();
+    pthread_mutex_unlock(&g_pool.lock);
+}
+
+void disk_writer_wait_drained(disk_writer_t* writer)
+{
+    log_buffer_t* buf = writer->log_buffer;
+    uint32_t target = atomic_load(&buf->head);
+    wake(writer);   // 写入线程可能正空闲等待，确保它被调度
+    pthread_mutex_lock(&writer->lock);
+    // head / tail 自由递增，用差值比较以容忍回绕
+    while ((int32_t)(atomic_load(&buf->tail) - target) < 0 && !writer->closed)
+        pthread_cond_wait(&writer->cond_drained, &writer->lock);
+    pthread_mutex_unlock(&writer->lock);
+}
+
+void disk_writer_notify(disk_writer_t* writer)
+{
+    if (atomic_exchange(&writer->armed, false))
+        wake(writer);
+}
+
+void disk_writer_add_waiter(disk_writer_t* writer, space_waiter_t* waiter)
+{
+    pthread_mutex_lock(&writer->space_lock);
+    waiter->armed = false;
+    waiter->next = writer->space_waiters;
+    writer->space_waiters = waiter;
+    pthread_mutex_unlock(&writer->space_lock);
+}
+
+void disk_writer_remove_waiter(disk_writer_t* writer, space_waiter_t* waiter)
+{
+    pthread_mutex_lock(&writer->space_lock);
+    for (space_waiter_t** p = &writer->space_waiters; *p; p = &(*p)->next) {
+        if (*p != waiter) continue;
+        *p = waiter->next;
+        if (waiter->armed) atomic_fetch_sub(&writer->space_armed, 1);
+        waiter->armed = false;
+        break;
+    }
+    pthread_mutex_unlock(&writer->space_lock);
+}
+
+void disk_writer_want_space(disk_writer_t* writer, space_waiter_t* waiter)
+{
+    pthread_mutex_lock(&writer->space_lock);
+    if (!waiter->armed) {
+        waiter->armed = true;
+        atomic_fetch_add(&writer->space_armed, 1);
+    }
+    pthread_mutex_unlock(&writer->space_lock);
+    // 登记后再复查：登记前写入线程可能已经腾出空间并跳过了通知
+    signal_space(writer);
+}
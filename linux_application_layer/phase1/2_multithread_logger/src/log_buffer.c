@@ -3,6 +3,7 @@
     @details 该文件包含日志缓冲区的定义，用于管理用于记录消息的环形缓冲区
     @details 该实现支持多线程环境下的读写操作
 */
+#include <errno.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -17,7 +18,6 @@
 #include <pthread.h>
 #include "../include/log_buffer.h"
 
-static atomic_uint_fast32_t global_log_id = 1; // 全局日志编号
 static atomic_uint_fast32_t write_fail_count = 0; // 写失败次数
 
 int log_buffer_init(log_buffer_t *buf)
@@ -29,12 +29,19 @@ int log_buffer_init(log_buffer_t *buf)
         buf->version = LOG_BUFFER_VERSION;
         atomic_store(&buf->head, 0);
         atomic_store(&buf->tail, 0);
+        atomic_store(&buf->next_id, 1);
+        atomic_store(&buf->next_seq, 1);
+        atomic_store(&buf->txn_active, 0);
         memset(buf->data, 0, BUFFER_SIZE);
         pthread_mutex_init(&buf->lock, NULL);
         pthread_cond_init(&buf->cond_can_read, NULL);
         pthread_cond_init(&buf->cond_can_write, NULL);
         return 1;  // 做了初始化
     }
+    // 保留数据，但锁和条件变量只属于上一个使用者（可能已被 destroy 或在崩溃时处于加锁状态），必须重建
+    pthread_mutex_init(&buf->lock, NULL);
+    pthread_cond_init(&buf->cond_can_read, NULL);
+    pthread_cond_init(&buf->cond_can_write, NULL);
     return 0;  // 已经初始化过
 }
 
@@ -48,101 +55,222 @@ void log_buffer_destroy(log_buffer_t* buf)
     pthread_mutex_destroy(&buf->lock);
 }
 
-bool log_buffer_write(log_buffer_t *buf, const char *msg) {
-    if (!buf || !msg) return false;
-    if (buf->magic != LOG_BUFFER_MAGIC || buf->version != LOG_BUFFER_VERSION)
+_Static_assert((BUFFER_SIZE & (BUFFER_SIZE - 1)) == 0, "BUFFER_SIZE 必须为 2 的幂");
+_Static_assert(LOG_RECORD_SIZE(LOG_RECORD_MAX_PAYLOAD) <= BUFFER_SIZE / 2, "单条记录过大");
+
+#define TEXT_PREFIX_MAX_LEN (sizeof("[4294967295] ") - 1)
+
+static bool buffer_valid(log_buffer_t *buf)
+{
+    return buf->magic == LOG_BUFFER_MAGIC && buf->version == LOG_BUFFER_VERSION;
+}
+
+// 需持有 buf->lock。为 len 字节负载预留空间，记录不跨越缓冲区末尾，放不下时尾部剩余部分作为填充。
+// 返回负载写入位置；空间不足且 wait 为 false 时返回 NULL
+static char *ring_reserve(log_buffer_t *buf, size_t len, bool wait)
+{
+    uint32_t need = LOG_RECORD_SIZE(len);
+    for (;;) {
+        uint32_t head = atomic_load(&buf->head);
+        uint32_t off = LOG_RING_OFFSET(head);
+        uint32_t pad = (off + need > BUFFER_SIZE) ? BUFFER_SIZE - off : 0;
+        uint32_t used = head - atomic_load(&buf->tail);
+        if (BUFFER_SIZE - used >= pad + need) {
+            if (pad) {
+                log_record_hdr_t hdr = { .len = pad - sizeof(hdr), .type = LOG_REC_PAD, .flags = 0, .seq = 0 };
+                memcpy(&buf->data[off], &hdr, sizeof(hdr));
+                atomic_store(&buf->head, head + pad);
+                off = 0;
+            }
+            return &buf->data[off + sizeof(log_record_hdr_t)];
+        }
+        if (!wait) return NULL;
+        pthread_cond_wait(&buf->cond_can_write, &buf->lock);
+    }
+}
+
+// 需持有 buf->lock。负载已写入 ring_reserve 返回的位置，写入记录头并发布
+static void ring_commit(log_buffer_t *buf, uint8_t type, size_t len)
+{
+    uint32_t head = atomic_load(&buf->head);
+    uint32_t off = LOG_RING_OFFSET(head);
+    uint32_t size = LOG_RECORD_SIZE(len);
+    log_record_hdr_t hdr = { .len = len, .type = type, .flags = 0,
+                             .seq = atomic_fetch_add(&buf->next_seq, 1) };
+    memcpy(&buf->data[off], &hdr, sizeof(hdr));
+    memset(&buf->data[off + sizeof(hdr) + len], 0, size - sizeof(hdr) - len);
+
+    // release：订阅者无锁读取，看到新的 head 时记录内容必须已经可见
+    atomic_store_explicit(&buf->head, head + size, memory_order_release);
+    pthread_cond_signal(&buf->cond_can_read);    // 通知读线程有数据了
+}
+
+static bool write_text(log_buffer_t *buf, const char *msg, bool wait)
+{
+    if (!buf || !msg || !buffer_valid(buf)) {
+        errno = EINVAL;
         return false;
+    }
 
     // 相当于 stanlen(msg,LOG_MESSAGE_MAX_LEN-1);
     size_t len;
     for (len = 0; len < LOG_MESSAGE_MAX_LEN-1 && msg[len]; len++);
 
-    // 保证写入字符串后加换行符，占用 LOG_MESSAGE_MAX_LEN 字节
-    size_t total = LOG_MESSAGE_MAX_LEN;
-    // 添加编号前缀
+    // 按最长编号前缀预留空间，总长不超过 LOG_MESSAGE_MAX_LEN - 1
+    size_t max_total = TEXT_PREFIX_MAX_LEN + len + 1;
+    if (max_total > LOG_MESSAGE_MAX_LEN - 1) max_total = LOG_MESSAGE_MAX_LEN - 1;
+
+    pthread_mutex_lock(&buf->lock);
+    char *payload = ring_reserve(buf, max_total, wait);
+    if (!payload) {
+        pthread_mutex_unlock(&buf->lock);
+        errno = EAGAIN;
+        return false;
+    }
+
+    // 确认有空间后才分配编号，非阻塞写失败不会留下编号空洞
     char temp_buf[LOG_MESSAGE_MAX_LEN] = {0};
-    uint32_t log_id = atomic_fetch_add(&global_log_id, 1);
+    uint32_t log_id = atomic_fetch_add(&buf->next_id, 1);
     int prefix_len = snprintf(temp_buf, sizeof(temp_buf), "[%u] ", log_id);
     size_t copy_len = (prefix_len + len > LOG_MESSAGE_MAX_LEN - 2) ? (LOG_MESSAGE_MAX_LEN - 2 - prefix_len) : len;
     memcpy(temp_buf + prefix_len, msg, copy_len);
     temp_buf[prefix_len + copy_len] = '\n';
 
-    pthread_mutex_lock(&buf->lock);
-    
-    // 判断环形缓冲区是否已满：满的条件可以简单约定为 next_head == tail
-    while (log_buffer_is_full(buf)) {
-        pthread_cond_wait(&buf->cond_can_write, &buf->lock);
-    }
+    memcpy(payload, temp_buf, prefix_len + copy_len + 1);
+    ring_commit(buf, LOG_REC_TEXT, prefix_len + copy_len + 1);
+    pthread_mutex_unlock(&buf->lock);
+    return true;
+}
 
-    uint32_t head = atomic_load(&buf->head);
-    uint32_t next_head = (head + total) % BUFFER_SIZE;
-    
-    // 如果未到缓冲区边界
-    if (head + total <= BUFFER_SIZE) {
-        memset(&buf->data[head], 0, total);
-        memcpy(&buf->data[head], temp_buf, prefix_len + copy_len + 1);
-    } else {
-        size_t part1 = BUFFER_SIZE - head;
-        size_t remain = prefix_len + copy_len + 1;
-        memset(&buf->data[head], 0, part1);
-        memcpy(&buf->data[head], temp_buf, part1 < remain ? part1 : remain);
-
-        size_t part2 = total - part1;
-        memset(&buf->data[0], 0, part2);
-        if (remain > part1) {
-            memcpy(&buf->data[0], temp_buf + part1, remain - part1);
-        }
+static bool write_record(log_buffer_t *buf, uint8_t type, const void *payload, size_t len, bool wait)
+{
+    if (!buf || (!payload && len) || type == LOG_REC_PAD || len > LOG_RECORD_MAX_PAYLOAD || !buffer_valid(buf)) {
+        errno = EINVAL;
+        return false;
     }
 
-    atomic_store(&buf->head, next_head);
-    pthread_cond_signal(&buf->cond_can_read);    // 通知读线程有数据了
+    pthread_mutex_lock(&buf->lock);
+    char *dst = ring_reserve(buf, len, wait);
+    if (!dst) {
+        pthread_mutex_unlock(&buf->lock);
+        errno = EAGAIN;
+        return false;
+    }
+    memcpy(dst, payload, len);
+    ring_commit(buf, type, len);
     pthread_mutex_unlock(&buf->lock);
     return true;
 }
 
-int log_buffer_read_batch(log_buffer_t *buf, char *out, size_t max_len)
+bool log_buffer_write(log_buffer_t *buf, const char *msg)
 {
-    if (!buf || !out) return 0;
-    if (buf->magic != LOG_BUFFER_MAGIC || buf->version != LOG_BUFFER_VERSION)
-        return 0;
+    return write_text(buf, msg, true);
+}
 
-    pthread_mutex_lock(&buf->lock);
-    
-    if (log_buffer_is_empty(buf)) {
-        pthread_cond_wait(&buf->cond_can_read, &buf->lock);
-    }
+bool log_buffer_try_write(log_buffer_t *buf, const char *msg)
+{
+    return write_text(buf, msg, false);
+}
+
+bool log_buffer_write_record(log_buffer_t *buf, uint8_t type, const void *payload, size_t len)
+{
+    return write_record(buf, type, payload, len, true);
+}
 
+bool log_buffer_try_write_record(log_buffer_t *buf, uint8_t type, const void *payload, size_t len)
+{
+    return write_record(buf, type, payload, len, false);
+}
+
+// 需持有 buf->lock。从 tail 起复制完整记录（跳过填充）到 out，返回字节数，*end 为之后的 tail
+static size_t collect(log_buffer_t *buf, char *out, size_t max_len, uint32_t *end)
+{
     uint32_t tail = atomic_load(&buf->tail);
     uint32_t head = atomic_load(&buf->head);
     size_t count = 0;
-    while (tail != head && count + LOG_MESSAGE_MAX_LEN <= max_len) {
-        if (tail + LOG_MESSAGE_MAX_LEN <= BUFFER_SIZE) {
-            memcpy(out + count, &buf->data[tail], LOG_MESSAGE_MAX_LEN);
-        } else {
-            size_t part1 = BUFFER_SIZE - tail;
-            memcpy(out + count, &buf->data[tail], part1);
-            memcpy(out + count + part1, &buf->data[0], LOG_MESSAGE_MAX_LEN - part1);
+    while (tail != head) {
+        uint32_t off = LOG_RING_OFFSET(tail);
+        log_record_hdr_t hdr;
+        memcpy(&hdr, &buf->data[off], sizeof(hdr));
+        uint32_t size = LOG_RECORD_SIZE(hdr.len);
+        if (hdr.type == LOG_REC_PAD) {
+            tail += size;
+            continue;
         }
-        tail = (tail + LOG_MESSAGE_MAX_LEN) % BUFFER_SIZE;
-        count += LOG_MESSAGE_MAX_LEN;
+        if (count + size > max_len) break;
+        memcpy(out + count, &buf->data[off], size);
+        tail += size;
+        count += size;
     }
+    *end = tail;
+    return count;
+}
+
+static int read_batch(log_buffer_t *buf, char *out, size_t max_len, bool wait)
+{
+    if (!buf || !out || !buffer_valid(buf)) return 0;
+
+    pthread_mutex_lock(&buf->lock);
+    
+    if (wait && log_buffer_is_empty(buf)) {
+        pthread_cond_wait(&buf->cond_can_read, &buf->lock);
+    }
+
+    uint32_t tail;
+    size_t count = collect(buf, out, max_len, &tail);
     atomic_store(&buf->tail, tail);
     pthread_cond_broadcast(&buf->cond_can_write); // 通知所有写线程，有空位了
     pthread_mutex_unlock(&buf->lock);
     return count;
 }
 
+int log_buffer_read_batch(log_buffer_t *buf, char *out, size_t max_len)
+{
+    return read_batch(buf, out, max_len, true);
+}
+
+int log_buffer_try_read_batch(log_buffer_t *buf, char *out, size_t max_len)
+{
+    return read_batch(buf, out, max_len, false);
+}
+
+int log_buffer_peek_batch(log_buffer_t *buf, char *out, size_t max_len, uint32_t *end)
+{
+    if (!buf || !out || !end || !buffer_valid(buf)) return 0;
+
+    pthread_mutex_lock(&buf->lock);
+    size_t count = collect(buf, out, max_len, end);
+    if (count == 0)
+        atomic_store(&buf->tail, *end);     // 只剩填充，直接跳过
+    pthread_mutex_unlock(&buf->lock);
+    return count;
+}
+
+void log_buffer_consume(log_buffer_t *buf, uint32_t end)
+{
+    if (!buf) return;
+    pthread_mutex_lock(&buf->lock);
+    atomic_store(&buf->tail, end);
+    pthread_cond_broadcast(&buf->cond_can_write); // 通知所有写线程，有空位了
+    pthread_mutex_unlock(&buf->lock);
+}
+
 bool log_buffer_is_empty(log_buffer_t *buf)
 {
     // 原子操作: 比较环形队列的 head 和 tail 指针的值，判断 head 和 tail 地址值是否相等
     return atomic_load(&buf->head) == atomic_load(&buf->tail);
 }
 
+size_t log_buffer_free_space(log_buffer_t *buf)
+{
+    return BUFFER_SIZE - (atomic_load(&buf->head) - atomic_load(&buf->tail));
+}
+
 bool log_buffer_is_full(log_buffer_t *buf)
 {
-    uint32_t head = atomic_load(&buf->head);
-    uint32_t tail = atomic_load(&buf->tail);
-    return ((head + LOG_MESSAGE_MAX_LEN) % BUFFER_SIZE) == tail;
+    // 剩余空间放不下最短的一条记录
+    uint32_t used = atomic_load(&buf->head) - atomic_load(&buf->tail);
+    return BUFFER_SIZE - used < LOG_RECORD_SIZE(0);
 }
 
 uint32_t log_buffer_get_write_fail_count(void) {
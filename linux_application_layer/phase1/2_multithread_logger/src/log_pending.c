@@ -0,0 +1,127 @@
+/**
+    @file log_pending.c
+    @brief 事件循环待写日志队列的实现
+    @details 单链表 FIFO，节点内联保存消息副本
+*/
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include "../include/log_buffer.h"
+#include "../include/log_pending.h"
+
+typedef struct pending_msg{
+    struct pending_msg* next;
+    char msg[];
+}pending_msg_t;
+
+struct log_pending{
+    logger_t* logger;
+    log_space_waiter_t* waiter;
+    pending_msg_t* head;
+    pending_msg_t* tail;
+    size_t count;
+    size_t max_pending;
+    size_t dropped;
+};
+
+log_pending_t* log_pending_create(logger_t* logger, size_t max_pending)
+{
+    if (!logger) return NULL;
+    log_pending_t* pending = calloc(1, sizeof(*pending));
+    if (!pending) return NULL;
+    pending->logger = logger;
+    pending->waiter = logger_space_waiter_open(logger);
+    if (!pending->waiter) {
+        free(pending);
+        return NULL;
+    }
+    pending->max_pending = max_pending ? max_pending : LOG_PENDING_DEFAULT_MAX;
+    return pending;
+}
+
+void log_pending_destroy(log_pending_t* pending)
+{
+    if (!pending) return;
+    pending_msg_t* p = pending->head;
+    while (p) {
+        pending_msg_t* next = p->next;
+        free(p);
+        p = next;
+    }
+    logger_space_waiter_close(pending->waiter);
+    free(pending);
+}
+
+static bool enqueue(log_pending_t* pending, const char* msg)
+{
+    if (pending->count >= pending->max_pending) {
+        pending->dropped++;
+        return false;
+    }
+    // 超出部分写入时也会被截断，这里只保留 LOG_MESSAGE_MAX_LEN 字节
+    size_t len = strnlen(msg, LOG_MESSAGE_MAX_LEN - 1);
+    pending_msg_t* node = malloc(sizeof(*node) + len + 1);
+    if (!node) {
+        pending->dropped++;
+        return false;
+    }
+    memcpy(node->msg, msg, len);
+    node->msg[len] = '\0';
+    node->next = NULL;
+    if (pending->tail) pending->tail->next = node;
+    else pending->head = node;
+    pending->tail = node;
+    pending->count++;
+    return true;
+}
+
+bool log_pending_log(log_pending_t* pending, const char* msg)
+{
+    if (!pending || !msg) return false;
+    if (!pending->head) {
+        if (logger_try_log(pending->logger, msg)) return true;
+        if (errno != EAGAIN) return false;
+        logger_space_waiter_arm(pending->waiter);   // 队列由空变非空：登记空间通知
+    }
+    return enqueue(pending, msg);
+}
+
+size_t log_pending_flush(log_pending_t* pending)
+{
+    if (!pending) return 0;
+    eventfd_t count;
+    eventfd_read(logger_space_waiter_fd(pending->waiter), &count);  // 非阻塞，清零通知
+    while (pending->head) {
+        pending_msg_t* node = pending->head;
+        if (!logger_try_log(pending->logger, node->msg)) {
+            if (errno == EAGAIN) {          // 重新登记，等待下一次空间就绪
+                logger_space_waiter_arm(pending->waiter);
+                break;
+            }
+            pending->dropped++;             // 其他错误无法重试，丢弃
+        }
+        pending->head = node->next;
+        if (!pending->head) pending->tail = NULL;
+        pending->count--;
+        free(node);
+    }
+    return pending->count;
+}
+
+int log_pending_fd(log_pending_t* pending)
+{
+    return pending ? logger_space_waiter_fd(pending->waiter) : -1;
+}
+
+size_t log_pending_count(log_pending_t* pending)
+{
+    return pending ? pending->count : 0;
+}
+
+size_t log_pending_dropped(log_pending_t* pending)
+{
+    return pending ? pending->dropped : 0;
+}
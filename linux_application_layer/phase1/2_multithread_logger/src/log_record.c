@@ -0,0 +1,310 @@
+/**
+    @file log_record.c
+    @brief 结构化日志记录的编码与解码实现
+    @details 整数使用 varint（有符号数先做 zigzag），浮点数按 8 字节小端存放，
+    @details 字符串为 varint 长度 + 原始字节，不带结尾 '\0'
+*/
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../include/log_record.h"
+
+/* ---------- 基础编码 ---------- */
+
+static int put_varint(uint8_t *out, size_t cap, size_t pos, uint64_t v)
+{
+    do {
+        if (pos >= cap) return -1;
+        uint8_t b = v & 0x7F;
+        v >>= 7;
+        out[pos++] = v ? (b | 0x80) : b;
+    } while (v);
+    return pos;
+}
+
+static int get_varint(const uint8_t *in, size_t len, size_t pos, uint64_t *v)
+{
+    uint64_t r = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (pos >= len) return -1;
+        uint8_t b = in[pos++];
+        r |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            *v = r;
+            return pos;
+        }
+    }
+    return -1;
+}
+
+static int put_u64le(uint8_t *out, size_t cap, size_t pos, uint64_t v)
+{
+    if (pos + 8 > cap) return -1;
+    for (int i = 0; i < 8; i++) out[pos++] = (uint8_t)(v >> (8 * i));
+    return pos;
+}
+
+static int get_u64le(const uint8_t *in, size_t len, size_t pos, uint64_t *v)
+{
+    if (pos + 8 > len) return -1;
+    uint64_t r = 0;
+    for (int i = 0; i < 8; i++) r |= (uint64_t)in[pos++] << (8 * i);
+    *v = r;
+    return pos;
+}
+
+static int put_bytes(uint8_t *out, size_t cap, size_t pos, const void *src, size_t n)
+{
+    if (pos + n > cap) return -1;
+    if (n) memcpy(out + pos, src, n);     // NULL 字符串值按空串编码，src 为 NULL 时不能传给 memcpy
+    return pos + n;
+}
+
+// 短名称：1 字节长度 + 字节
+static int put_name(uint8_t *out, size_t cap, size_t pos, const char *name)
+{
+    size_t n = strlen(name);
+    if (pos + 1 + n > cap) return -1;
+    out[pos++] = (uint8_t)n;
+    return put_bytes(out, cap, pos, name, n);
+}
+
+static int get_name(const uint8_t *in, size_t len, size_t pos, char *name)
+{
+    if (pos >= len) return -1;
+    size_t n = in[pos++];
+    if (n > LOG_NAME_MAX_LEN || pos + n > len) return -1;
+    memcpy(name, in + pos, n);
+    name[n] = '\0';
+    return pos + n;
+}
+
+/* ---------- schema ---------- */
+
+bool log_schema_init(log_schema_t *schema, uint16_t id, const char *name,
+                     const log_field_def_t *fields, size_t field_count)
+{
+    if (!schema || !name || (!fields && field_count)) return false;
+    if (strlen(name) > LOG_NAME_MAX_LEN || field_count > LOG_SCHEMA_MAX_FIELDS) return false;
+
+    memset(schema, 0, sizeof(*schema));
+    schema->id = id;
+    schema->field_count = field_count;
+    strcpy(schema->name, name);
+    for (size_t i = 0; i < field_count; i++) {
+        if (!fields[i].name || strlen(fields[i].name) > LOG_NAME_MAX_LEN) return false;
+        if (fields[i].type < LOG_FIELD_I64 || fields[i].type > LOG_FIELD_BOOL) return false;
+        strcpy(schema->field_names[i], fields[i].name);
+        schema->field_types[i] = fields[i].type;
+    }
+    return true;
+}
+
+int log_schema_encode(const log_schema_t *schema, uint8_t *out, size_t cap)
+{
+    int pos = 0;
+    if (cap < 3) return -1;
+    out[pos++] = schema->id & 0xFF;
+    out[pos++] = schema->id >> 8;
+    out[pos++] = schema->field_count;
+    if ((pos = put_name(out, cap, pos, schema->name)) < 0) return -1;
+    for (int i = 0; i < schema->field_count; i++) {
+        if ((size_t)pos >= cap) return -1;
+        out[pos++] = schema->field_types[i];
+        if ((pos = put_name(out, cap, pos, schema->field_names[i])) < 0) return -1;
+    }
+    return pos;
+}
+
+bool log_schema_decode(log_schema_t *schema, const uint8_t *in, size_t len)
+{
+    int pos = 0;
+    if (!schema || !in || len < 3) return false;
+    memset(schema, 0, sizeof(*schema));
+    schema->id = in[0] | (in[1] << 8);
+    schema->field_count = in[2];
+    pos = 3;
+    if (schema->field_count > LOG_SCHEMA_MAX_FIELDS) return false;
+    if ((pos = get_name(in, len, pos, schema->name)) < 0) return false;
+    for (int i = 0; i < schema->field_count; i++) {
+        if ((size_t)pos >= len) return false;
+        schema->field_types[i] = in[pos++];
+        if (schema->field_types[i] < LOG_FIELD_I64 || schema->field_types[i] > LOG_FIELD_BOOL) return false;
+        if ((pos = get_name(in, len, pos, schema->field_names[i])) < 0) return false;
+    }
+    return (size_t)pos == len;
+}
+
+/* ---------- 键值记录 ---------- */
+
+int log_kv_encode(const log_schema_t *schema, uint64_t ts_ns, uint8_t *out, size_t cap, va_list ap)
+{
+    int pos = 0;
+    if (cap < 2) return -1;
+    out[pos++] = schema->id & 0xFF;
+    out[pos++] = schema->id >> 8;
+    if ((pos = put_u64le(out, cap, pos, ts_ns)) < 0) return -1;
+
+    for (int i = 0; i < schema->field_count && pos >= 0; i++) {
+        switch (schema->field_types[i]) {
+            case LOG_FIELD_I64: {
+                int64_t v = va_arg(ap, int64_t);
+                pos = put_varint(out, cap, pos, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+                break;
+            }
+            case LOG_FIELD_U64:
+                pos = put_varint(out, cap, pos, va_arg(ap, uint64_t));
+                break;
+            case LOG_FIELD_F64: {
+                double d = va_arg(ap, double);
+                uint64_t bits;
+                memcpy(&bits, &d, sizeof(bits));
+                pos = put_u64le(out, cap, pos, bits);
+                break;
+            }
+            case LOG_FIELD_STR: {
+                const char *str = va_arg(ap, const char *);
+                size_t n = str ? strlen(str) : 0;
+                if ((pos = put_varint(out, cap, pos, n)) >= 0)
+                    pos = put_bytes(out, cap, pos, str, n);
+                break;
+            }
+            case LOG_FIELD_BOOL:
+                if ((size_t)pos >= cap) return -1;
+                out[pos++] = va_arg(ap, int) ? 1 : 0;
+                break;
+            default:
+                return -1;
+        }
+    }
+    return pos;
+}
+
+int log_kv_schema_id(const uint8_t *in, size_t len)
+{
+    if (!in || len < 10) return -1;
+    return in[0] | (in[1] << 8);
+}
+
+// 带边界检查的输出缓冲
+typedef struct{
+    char *buf;
+    size_t cap;
+    size_t len;
+    bool overflow;
+}out_buf_t;
+
+static void out_printf(out_buf_t *o, const char *fmt, ...)
+{
+    if (o->overflow) return;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(o->buf + o->len, o->cap - o->len, fmt, ap);
+    va_end(ap);
+    if (n < 0 || (size_t)n >= o->cap - o->len) {
+        o->overflow = true;
+        return;
+    }
+    o->len += n;
+}
+
+// 输出带引号的字符串，转义引号、反斜杠和控制字符（文本与 JSON 通用）
+static void out_quoted(out_buf_t *o, const uint8_t *s, size_t n)
+{
+    out_printf(o, "\"");
+    for (size_t i = 0; i < n && !o->overflow; i++) {
+        uint8_t c = s[i];
+        if (c == '"' || c == '\\') out_printf(o, "\\%c", c);
+        else if (c == '\n') out_printf(o, "\\n");
+        else if (c == '\t') out_printf(o, "\\t");
+        else if (c < 0x20) out_printf(o, "\\u%04x", c);
+        else out_printf(o, "%c", c);
+    }
+    out_printf(o, "\"");
+}
+
+// 优先用较短的 15 位有效数字，无法精确还原时退回 17 位
+static void out_double(out_buf_t *o, double d)
+{
+    char tmp[32];
+    snprintf(tmp, sizeof(tmp), "%.15g", d);
+    if (strtod(tmp, NULL) != d)
+        snprintf(tmp, sizeof(tmp), "%.17g", d);
+    out_printf(o, "%s", tmp);
+}
+
+int log_kv_format(const log_schema_t *schema, const uint8_t *in, size_t len,
+                  log_format_t format, char *out, size_t cap)
+{
+    if (!schema || !out || cap == 0 || log_kv_schema_id(in, len) != schema->id) return -1;
+
+    out_buf_t o = { out, cap, 0, false };
+    uint64_t ts_ns;
+    int pos = get_u64le(in, len, 2, &ts_ns);
+
+    time_t sec = ts_ns / 1000000000ULL;
+    struct tm tm;
+    char ts[32];
+    gmtime_r(&sec, &tm);
+    strftime(ts, sizeof(ts), "%Y-%m-%dT%H:%M:%S", &tm);
+
+    bool json = (format == LOG_FORMAT_JSON);
+    if (json) {
+        out_printf(&o, "{\"ts\":\"%s.%09lluZ\",\"schema\":", ts, (unsigned long long)(ts_ns % 1000000000ULL));
+        out_quoted(&o, (const uint8_t *)schema->name, strlen(schema->name));
+    } else
+        out_printf(&o, "%s.%09lluZ %s", ts, (unsigned long long)(ts_ns % 1000000000ULL), schema->name);
+
+    for (int i = 0; i < schema->field_count && pos >= 0; i++) {
+        if (json) {     // 名称可能含引号或反斜杠，与值一样转义
+            out_printf(&o, ",");
+            out_quoted(&o, (const uint8_t *)schema->field_names[i], strlen(schema->field_names[i]));
+            out_printf(&o, ":");
+        } else {
+            out_printf(&o, " %s=", schema->field_names[i]);
+        }
+
+        uint64_t v;
+        switch (schema->field_types[i]) {
+            case LOG_FIELD_I64:
+                if ((pos = get_varint(in, len, pos, &v)) >= 0)
+                    out_printf(&o, "%lld", (long long)((v >> 1) ^ -(v & 1)));
+                break;
+            case LOG_FIELD_U64:
+                if ((pos = get_varint(in, len, pos, &v)) >= 0)
+                    out_printf(&o, "%llu", (unsigned long long)v);
+                break;
+            case LOG_FIELD_F64:
+                if ((pos = get_u64le(in, len, pos, &v)) >= 0) {
+                    double d;
+                    memcpy(&d, &v, sizeof(d));
+                    // JSON 不支持 nan/inf
+                    if (json && (d != d || d - d != 0)) out_printf(&o, "null");
+                    else out_double(&o, d);
+                }
+                break;
+            case LOG_FIELD_STR:
+                if ((pos = get_varint(in, len, pos, &v)) >= 0) {
+                    if (v > len - pos) return -1;
+                    out_quoted(&o, in + pos, v);
+                    pos += v;
+                }
+                break;
+            case LOG_FIELD_BOOL:
+                if ((size_t)pos >= len) return -1;
+                out_printf(&o, "%s", in[pos++] ? "true" : "false");
+                break;
+            default:
+                return -1;
+        }
+    }
+    if (pos < 0 || (size_t)pos != len) return -1;
+
+    out_printf(&o, json ? "}\n" : "\n");
+    return o.overflow ? -1 : (int)o.len;
+}
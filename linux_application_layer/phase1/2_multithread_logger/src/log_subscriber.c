@@ -0,0 +1,149 @@
+/**
+    @file log_subscriber.c
+    @brief 环形缓冲区只读订阅游标的实现
+    @details 读取方式类似 seqlock：先复制记录，再重新读取 head / tail 判断复制期间是否可能被覆盖。
+    @details 写线程只会写入 [head, tail + BUFFER_SIZE) 范围，且正在写的记录（含填充）不超过
+    @details 2 * LOG_RECORD_SIZE(LOG_RECORD_MAX_PAYLOAD) 字节，满足任一条件即说明复制到的内容完整。
+*/
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "../include/log_subscriber.h"
+
+#define MAX_IN_FLIGHT   (2 * LOG_RECORD_SIZE(LOG_RECORD_MAX_PAYLOAD))
+
+static uint32_t load_head(const log_buffer_t* buf)
+{
+    return atomic_load_explicit((atomic_uint*)&buf->head, memory_order_acquire);
+}
+
+static uint32_t load_tail(const log_buffer_t* buf)
+{
+    return atomic_load_explicit((atomic_uint*)&buf->tail, memory_order_acquire);
+}
+
+// 复制完成后调用：[pos, pos + size) 在复制期间没有被写线程触及
+static bool still_valid(const log_buffer_t* buf, uint32_t pos)
+{
+    atomic_thread_fence(memory_order_acquire);
+    uint32_t head = load_head(buf);
+    uint32_t tail = load_tail(buf);
+    return (int32_t)(tail - pos) <= 0 ||
+           (int32_t)(pos + BUFFER_SIZE - head) >= (int32_t)MAX_IN_FLIGHT;
+}
+
+// 从 pos 起找到第一条非填充记录的序号：1 找到； 0 直到 head 都没有可用记录； -1 复制期间被覆盖，需要重试
+static int first_seq(const log_buffer_t* buf, uint32_t pos, uint32_t head, uint32_t* seq)
+{
+    while (pos != head) {
+        log_record_hdr_t hdr;
+        uint32_t off = LOG_RING_OFFSET(pos);
+        memcpy(&hdr, &buf->data[off], sizeof(hdr));
+        size_t size = LOG_RECORD_SIZE(hdr.len);
+        bool sane = hdr.len <= LOG_RECORD_MAX_PAYLOAD && off + size <= BUFFER_SIZE && size <= (uint32_t)(head - pos);
+        if (!still_valid(buf, pos)) return -1;
+        if (!sane) return 0;    // 记录头损坏，无法确定序号
+        if (hdr.type != LOG_REC_PAD) {
+            *seq = hdr.seq;
+            return 1;
+        }
+        pos += size;
+    }
+    return 0;
+}
+
+void log_subscriber_attach(log_subscriber_t* sub, const log_buffer_t* buf, bool from_oldest)
+{
+    memset(sub, 0, sizeof(*sub));
+    sub->cr.fd = -1;
+    sub->buf = buf;
+    if (from_oldest) {
+        // 挂上时就确定期望的序号，否则读到第一条之前被覆盖的记录无法计入错过数
+        for (;;) {
+            uint32_t tail = load_tail(buf);
+            uint32_t head = load_head(buf);
+            int found = first_seq(buf, tail, head, &sub->next_seq);
+            if (found < 0) continue;
+            // 没有可用记录：先读 head 再读序号，理由同下
+            if (found == 0) sub->next_seq = atomic_load((atomic_uint*)&buf->next_seq);
+            sub->pos = tail;
+            break;
+        }
+    } else {
+        // 先读 head 再读序号：中间若有新记录发布，该记录序号小于 next_seq，不会误报错过
+        sub->pos = load_head(buf);
+        sub->next_seq = atomic_load((atomic_uint*)&buf->next_seq);
+    }
+}
+
+bool log_subscriber_open(log_subscriber_t* sub, const char* backing_file, bool from_oldest)
+{
+    if (!sub) return false;
+    crash_recovery_t cr;
+    if (!crash_recovery_open_readonly(&cr, backing_file)) return false;
+    log_subscriber_attach(sub, cr.log_buffer, from_oldest);
+    sub->cr = cr;
+    return true;
+}
+
+void log_subscriber_close(log_subscriber_t* sub)
+{
+    if (!sub) return;
+    if (sub->cr.mapped_addr) crash_recovery_cleanup(&sub->cr);
+    sub->buf = NULL;
+}
+
+int log_subscriber_read(log_subscriber_t* sub, log_record_hdr_t* hdr, void* payload, size_t cap, uint32_t* missed)
+{
+    if (!sub || !sub->buf || !hdr || !payload) return 0;
+    const log_buffer_t* buf = sub->buf;
+    if (missed) *missed = 0;
+
+    for (;;) {
+        uint32_t head = load_head(buf);
+        int32_t ahead = (int32_t)(head - sub->pos);
+        if (ahead == 0) return 0;
+        if (ahead < 0 || ahead > BUFFER_SIZE) {
+            // 游标已失效（落后超过一圈，或缓冲区被重新初始化）：跳到最旧的记录
+            sub->pos = load_tail(buf);
+            continue;
+        }
+
+        uint32_t off = LOG_RING_OFFSET(sub->pos);
+        memcpy(hdr, &buf->data[off], sizeof(*hdr));
+        size_t size = LOG_RECORD_SIZE(hdr->len);
+        bool sane = hdr->len <= LOG_RECORD_MAX_PAYLOAD && off + size <= BUFFER_SIZE && size <= (size_t)ahead;
+        if (sane && hdr->type != LOG_REC_PAD && hdr->len <= cap)
+            memcpy(payload, &buf->data[off + sizeof(*hdr)], hdr->len);
+
+        if (!sane || !still_valid(buf, sub->pos)) {
+            sub->pos = load_tail(buf);
+            continue;
+        }
+        sub->pos += size;
+        if (hdr->type == LOG_REC_PAD) continue;
+        if (hdr->len > cap) continue;   // 调用方缓冲区太小，跳过，按错过计数
+
+        // 序号跳跃即为被覆盖而错过的记录（序号回退说明缓冲区被重新初始化，重新计数）
+        if ((int32_t)(hdr->seq - sub->next_seq) > 0) {
+            uint32_t gap = hdr->seq - sub->next_seq;
+            sub->missed += gap;
+            if (missed) *missed = gap;
+        }
+        sub->next_seq = hdr->seq + 1;
+        return 1;
+    }
+}
+
+bool log_subscriber_wait(log_subscriber_t* sub, int timeout_ms)
+{
+    if (!sub || !sub->buf) return false;
+    struct timespec tick = { 0, 1000 * 1000 };     // 1ms
+    for (int waited = 0; timeout_ms < 0 || waited <= timeout_ms; waited++) {
+        if (load_head(sub->buf) != sub->pos) return true;
+        nanosleep(&tick, NULL);
+    }
+    return false;
+}
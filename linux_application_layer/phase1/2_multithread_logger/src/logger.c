@@ -1,50 +1,261 @@
-
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
 #include "../include/logger.h"
 #include "../include/log_buffer.h"
 #include "../include/disk_writer.h"
 #include "../include/crash_recovery.h"
 
+struct logger{
+    crash_recovery_t cr;
+    disk_writer_t writer;
+    log_schema_t schemas[LOG_SCHEMA_MAX];   // 下标 = schema id - 1
+    int schema_count;
+    pthread_mutex_t schema_lock;
+};
 
-static crash_recovery_t g_cr;
-static disk_writer_t g_writer;
-static bool g_logger_initialized = false;
+struct log_space_waiter{
+    logger_t* logger;
+    space_waiter_t w;
+};
 
+static logger_t* g_logger = NULL;       // logger_init 打开的默认实例
 
-bool logger_init(const char* filepath, size_t buffer_size)
+
+logger_t* logger_open(const logger_config_t* config)
 {
-    if (g_logger_initialized) return true;
+    logger_config_t defaults = {0};
+    if (!config) config = &defaults;
 
-    if (!crash_recovery_init(&g_cr, filepath, buffer_size)) {
+    logger_t* logger = calloc(1, sizeof(*logger));
+    if (!logger) return NULL;
+
+    if (!crash_recovery_init(&logger->cr, config->backing_file, config->buffer_size)) {
         fprintf(stderr, "Failed to initialize crash recovery\n");
-        return false;
+        free(logger);
+        return NULL;
     }
 
-    log_buffer_t* buf = crash_recovery_get_buffer(&g_cr);
-    if (!disk_writer_start(&g_writer, buf)) {
+    log_buffer_t* buf = crash_recovery_get_buffer(&logger->cr);
+    if (!disk_writer_start(&logger->writer, buf, config->text_path, config->binary_path,
+                           config->space_watermark)) {
         fprintf(stderr, "Failed to start disk writer\n");
-        crash_recovery_cleanup(&g_cr);
+        crash_recovery_cleanup(&logger->cr);
+        free(logger);
+        return NULL;
+    }
+    pthread_mutex_init(&logger->schema_lock, NULL);
+    return logger;
+}
+
+void logger_close(logger_t* logger)
+{
+    if (!logger) return;
+    disk_writer_stop(&logger->writer);
+    log_buffer_destroy(logger->cr.log_buffer);
+    crash_recovery_cleanup(&logger->cr);
+    pthread_mutex_destroy(&logger->schema_lock);
+    free(logger);
+}
+
+bool logger_log(logger_t* logger, const char* msg)
+{
+    if (!logger || !msg) return false;
+    if (!log_buffer_write(logger->cr.log_buffer, msg)) return false;
+    disk_writer_notify(&logger->writer);
+    return true;
+}
+
+bool logger_try_log(logger_t* logger, const char* msg)
+{
+    if (!logger || !msg) {
+        errno = EINVAL;
         return false;
     }
+    if (!log_buffer_try_write(logger->cr.log_buffer, msg)) return false;
+    disk_writer_notify(&logger->writer);
+    return true;
+}
+
+log_space_waiter_t* logger_space_waiter_open(logger_t* logger)
+{
+    if (!logger) return NULL;
+    log_space_waiter_t* waiter = calloc(1, sizeof(*waiter));
+    if (!waiter) return NULL;
+    waiter->logger = logger;
+    waiter->w.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (waiter->w.fd < 0) {
+        perror("eventfd");
+        free(waiter);
+        return NULL;
+    }
+    disk_writer_add_waiter(&logger->writer, &waiter->w);
+    return waiter;
+}
+
+void logger_space_waiter_close(log_space_waiter_t* waiter)
+{
+    if (!waiter) return;
+    disk_writer_remove_waiter(&waiter->logger->writer, &waiter->w);
+    close(waiter->w.fd);
+    free(waiter);
+}
+
+int logger_space_waiter_fd(log_space_waiter_t* waiter)
+{
+    return waiter ? waiter->w.fd : -1;
+}
+
+void logger_space_waiter_arm(log_space_waiter_t* waiter)
+{
+    if (waiter) disk_writer_want_space(&waiter->logger->writer, &waiter->w);
+}
 
-    g_logger_initialized = true;
+bool logger_sync(logger_t* logger)
+{
+    if (!logger) return false;
+    return crash_recovery_flush(&logger->cr);
+}
+
+bool logger_drain(logger_t* logger)
+{
+    if (!logger) return false;
+    disk_writer_wait_drained(&logger->writer);
     return true;
 }
+
+int logger_add_schema(logger_t* logger, const char* name, const log_field_def_t* fields, size_t field_count)
+{
+    if (!logger || !name) return -1;
+
+    pthread_mutex_lock(&logger->schema_lock);
+    for (int i = 0; i < logger->schema_count; i++) {
+        if (strcmp(logger->schemas[i].name, name) == 0) {
+            pthread_mutex_unlock(&logger->schema_lock);
+            return i + 1;
+        }
+    }
+
+    int id = -1;
+    uint8_t payload[LOG_RECORD_MAX_PAYLOAD];
+    log_schema_t* schema = &logger->schemas[logger->schema_count];
+    if (logger->schema_count < LOG_SCHEMA_MAX &&
+        log_schema_init(schema, logger->schema_count + 1, name, fields, field_count)) {
+        int len = log_schema_encode(schema, payload, sizeof(payload));
+        // 持锁写入，保证 schema 记录先于使用它的键值记录进入缓冲区
+        if (len > 0 && log_buffer_write_record(logger->cr.log_buffer, LOG_REC_SCHEMA, payload, len)) {
+            id = ++logger->schema_count;
+            disk_writer_notify(&logger->writer);
+        }
+    }
+    pthread_mutex_unlock(&logger->schema_lock);
+    return id;
+}
+
+static bool logger_vlog_kv(logger_t* logger, int schema_id, bool wait, va_list ap)
+{
+    if (!logger) {
+        errno = EINVAL;
+        return false;
+    }
+    // schema 只增不改，id 有效后可无锁读取
+    pthread_mutex_lock(&logger->schema_lock);
+    bool valid = schema_id >= 1 && schema_id <= logger->schema_count;
+    pthread_mutex_unlock(&logger->schema_lock);
+    if (!valid) {
+        errno = EINVAL;
+        return false;
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint64_t ts_ns = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+
+    uint8_t payload[LOG_RECORD_MAX_PAYLOAD];
+    int len = log_kv_encode(&logger->schemas[schema_id - 1], ts_ns, payload, sizeof(payload), ap);
+    if (len < 0) {
+        errno = EMSGSIZE;
+        return false;
+    }
+    bool ok = wait ? log_buffer_write_record(logger->cr.log_buffer, LOG_REC_KV, payload, len)
+                   : log_buffer_try_write_record(logger->cr.log_buffer, LOG_REC_KV, payload, len);
+    if (!ok) return false;
+    disk_writer_notify(&logger->writer);
+    return true;
+}
+
+bool logger_log_kv(logger_t* logger, int schema_id, ...)
+{
+    va_list ap;
+    va_start(ap, schema_id);
+    bool ok = logger_vlog_kv(logger, schema_id, true, ap);
+    va_end(ap);
+    return ok;
+}
+
+bool logger_try_log_kv(logger_t* logger, int schema_id, ...)
+{
+    va_list ap;
+    va_start(ap, schema_id);
+    bool ok = logger_vlog_kv(logger, schema_id, false, ap);
+    va_end(ap);
+    return ok;
+}
+
+bool logger_subscribe(logger_t* logger, log_subscriber_t* sub, bool from_oldest)
+{
+    if (!logger || !sub) return false;
+    log_subscriber_attach(sub, logger->cr.log_buffer, from_oldest);
+    return true;
+}
+
+bool logger_set_writer_threads(int threads)
+{
+    return disk_writer_pool_set_threads(threads);
+}
+
+
+bool logger_init(const char* filepath, size_t buffer_size)
+{
+    if (g_logger) return true;
+    logger_config_t config = { .backing_file = filepath, .buffer_size = buffer_size };
+    g_logger = logger_open(&config);
+    return g_logger != NULL;
+}
 void logger_shutdown(void)
 {
-    if (!g_logger_initialized) return;
-    disk_writer_stop(&g_writer);
-    log_buffer_destroy(g_cr.log_buffer);
-    crash_recovery_cleanup(&g_cr);
-    g_logger_initialized = false;
+    if (!g_logger) return;
+    logger_close(g_logger);
+    g_logger = NULL;
 }
 bool logger_write(const char* msg)
 {
-    if (!g_logger_initialized || !msg)  return false;
-    return log_buffer_write(g_cr.log_buffer, msg);
+    return logger_log(g_logger, msg);
 }
 bool logger_flush(void)
 {
-    if (!g_logger_initialized) return false;
-    return crash_recovery_flush(&g_cr);
-}
\ No newline at end of file
+    return logger_sync(g_logger);
+}
+bool logger_drain_default(void)
+{
+    return logger_drain(g_logger);
+}
+int logger_register_schema(const char* name, const log_field_def_t* fields, size_t field_count)
+{
+    return logger_add_schema(g_logger, name, fields, field_count);
+}
+bool logger_write_kv(int schema_id, ...)
+{
+    va_list ap;
+    va_start(ap, schema_id);
+    bool ok = logger_vlog_kv(g_logger, schema_id, true, ap);
+    va_end(ap);
+    return ok;
+}
@@ -0,0 +1,252 @@
+/**
+    @file crash_torture.c
+    @brief 崩溃一致性压力测试
+    @details 反复 fork 生产者进程用 logger_write 写日志，在随机时刻 SIGKILL（包括 disk_writer 正在落盘一批记录时），
+    @details 再用同一个 log_buffer.mmap 重启；最后一次正常启动排空缓冲区后校验 persisted_log.txt：
+    @details 已提交（logger_write 返回 true）的消息不丢失、不重复、没有被截断的行，并统计启动恢复耗时分布
+    @details 用法：crash_torture [-n 轮数] [-t 每个进程的线程数] [-m 最长存活毫秒] [-d 工作目录]
+*/
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "../include/logger.h"
+
+#define MAX_THREADS     16
+#define MAX_SEQ         (1 << 20)   // 每个线程每轮最多写入的消息数
+
+// 父子进程共享：每轮每个线程已提交的消息数，以及每轮启动恢复耗时
+typedef struct{
+    atomic_uint committed[MAX_THREADS];
+    atomic_int ready;               // 子进程 logger_init 完成
+    double recovery_ms;
+}run_state_t;
+
+static int g_threads = 4;
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+typedef struct{
+    int run;
+    int thread;
+    run_state_t* state;
+}producer_arg_t;
+
+static void* producer_thread(void* arg)
+{
+    producer_arg_t* p = arg;
+    char msg[128];
+    for (unsigned seq = 0; seq < MAX_SEQ; seq++) {
+        snprintf(msg, sizeof(msg), "run=%d t=%d seq=%u", p->run, p->thread, seq);
+        if (!logger_write(msg)) {
+            fprintf(stderr, "logger_write failed\n");
+            _exit(2);
+        }
+        // logger_write 返回后才算已提交
+        atomic_store(&p->state->committed[p->thread], seq + 1);
+    }
+    return NULL;
+}
+
+// 子进程：恢复并写日志，直到被杀死；threads == 0 时只做恢复并正常关闭
+static void child_main(int run, int threads, run_state_t* state)
+{
+    // 恢复包括 logger_init（回滚写了一半的批次）和写入线程池重写缓冲区中的残留记录
+    double t0 = now_ms();
+    if (!logger_init("log_buffer.mmap", 0) || !logger_drain_default()) _exit(3);
+    state->recovery_ms = now_ms() - t0;
+    atomic_store(&state->ready, 1);
+
+    if (threads == 0) {
+        logger_shutdown();
+        _exit(0);
+    }
+    pthread_t tids[MAX_THREADS];
+    producer_arg_t args[MAX_THREADS];
+    for (int i = 0; i < threads; i++) {
+        args[i] = (producer_arg_t){ run, i, state };
+        pthread_create(&tids[i], NULL, producer_thread, &args[i]);
+    }
+    for (int i = 0; i < threads; i++) pthread_join(tids[i], NULL);
+    logger_shutdown();
+    _exit(0);
+}
+
+static int cmp_double(const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// 校验落盘文件，返回错误数
+static long verify(const char* path, run_state_t* states, int runs)
+{
+    FILE* fp = fopen(path, "r");
+    if (!fp) {
+        perror("fopen");
+        return 1;
+    }
+    // seen[run][thread] 为按 seq 索引的位图
+    uint8_t** seen = calloc((size_t)runs * g_threads, sizeof(uint8_t*));
+    long errors = 0, lines = 0, dup_ids = 0;
+    uint32_t max_id = 0;
+    uint8_t* id_seen = calloc(1, 1);
+    size_t id_cap = 1;
+    char line[512];
+
+    while (fgets(line, sizeof(line), fp)) {
+        lines++;
+        unsigned id, seq;
+        int run, thread, n = 0;
+        size_t len = strlen(line);
+        if (len == 0 || line[len - 1] != '\n' ||
+            sscanf(line, "[%u] run=%d t=%d seq=%u%n", &id, &run, &thread, &seq, &n) != 4 ||
+            (size_t)n != len - 1 || run < 0 || run >= runs || thread < 0 || thread >= g_threads || seq >= MAX_SEQ) {
+            if (errors++ < 10) fprintf(stderr, "torn/invalid line %ld: %s", lines, line);
+            continue;
+        }
+        uint8_t** bits = &seen[(size_t)run * g_threads + thread];
+        if (!*bits) *bits = calloc(MAX_SEQ / 8, 1);
+        if ((*bits)[seq / 8] & (1 << (seq % 8))) {
+            if (errors++ < 10) fprintf(stderr, "duplicate message: %s", line);
+        }
+        (*bits)[seq / 8] |= 1 << (seq % 8);
+
+        // 日志编号随 mmap 持久化，跨重启也不应重复
+        if (id / 8 >= id_cap) {
+            size_t cap = id_cap;
+            while (id / 8 >= cap) cap *= 2;
+            id_seen = realloc(id_seen, cap);
+            memset(id_seen + id_cap, 0, cap - id_cap);
+            id_cap = cap;
+        }
+        if (id_seen[id / 8] & (1 << (id % 8))) dup_ids++;
+        id_seen[id / 8] |= 1 << (id % 8);
+        if (id > max_id) max_id = id;
+    }
+    fclose(fp);
+
+    long lost = 0, uncommitted = 0;
+    for (int r = 0; r < runs; r++) {
+        for (int t = 0; t < g_threads; t++) {
+            unsigned committed = atomic_load(&states[r].committed[t]);
+            uint8_t* bits = seen[(size_t)r * g_threads + t];
+            for (unsigned s = 0; s < committed; s++) {
+                if (!bits || !(bits[s / 8] & (1 << (s % 8)))) {
+                    if (lost++ < 10) fprintf(stderr, "lost committed message run=%d t=%d seq=%u\n", r, t, s);
+                }
+            }
+            // 被杀时正在写的那一条（seq == committed）可能已进入缓冲区，之后的不可能出现
+            for (unsigned s = committed + 1; bits && s < MAX_SEQ; s++) {
+                if (bits[s / 8] & (1 << (s % 8))) uncommitted++;
+            }
+            free(bits);
+        }
+    }
+    free(seen);
+    free(id_seen);
+
+    printf("lines: %ld, max id: %u\n", lines, max_id);
+    printf("torn/invalid: %ld, lost: %ld, phantom: %ld, duplicate ids: %ld\n",
+           errors, lost, uncommitted, dup_ids);
+    return errors + lost + uncommitted + dup_ids;
+}
+
+int main(int argc, char* argv[])
+{
+    int iterations = 50, max_alive_ms = 50;
+    const char* dir = "torture_dir";
+    int opt;
+    while ((opt = getopt(argc, argv, "n:t:m:d:")) != -1) {
+        switch (opt) {
+            case 'n': iterations = atoi(optarg); break;
+            case 't': g_threads = atoi(optarg); break;
+            case 'm': max_alive_ms = atoi(optarg); break;
+            case 'd': dir = optarg; break;
+            default:
+                fprintf(stderr, "Usage: %s [-n iterations] [-t threads] [-m max_alive_ms] [-d dir]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (iterations < 1 || g_threads < 1 || g_threads > MAX_THREADS || max_alive_ms < 1) {
+        fprintf(stderr, "invalid arguments\n");
+        return EXIT_FAILURE;
+    }
+
+    // 在干净的工作目录中运行，logger 使用默认文件名
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        perror("mkdir");
+        return EXIT_FAILURE;
+    }
+    if (chdir(dir) != 0) {
+        perror("chdir");
+        return EXIT_FAILURE;
+    }
+    unlink("log_buffer.mmap");
+    unlink("persisted_log.txt");
+    unlink("persisted_log.bin");
+
+    int runs = iterations + 1;      // 最后一轮只做恢复
+    run_state_t* states = mmap(NULL, sizeof(run_state_t) * runs, PROT_READ | PROT_WRITE,
+                               MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (states == MAP_FAILED) {
+        perror("mmap");
+        return EXIT_FAILURE;
+    }
+    srand(time(NULL) ^ getpid());
+
+    for (int r = 0; r < runs; r++) {
+        bool final_run = (r == iterations);
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            return EXIT_FAILURE;
+        }
+        if (pid == 0) {
+            setvbuf(stdout, NULL, _IONBF, 0);
+            child_main(r, final_run ? 0 : g_threads, &states[r]);
+        }
+
+        int status;
+        if (!final_run) {
+            // 等恢复完成后再随机存活一段时间，确保杀在写入/落盘过程中而不是恢复过程中
+            while (!atomic_load(&states[r].ready) && waitpid(pid, &status, WNOHANG) == 0)
+                usleep(100);
+            struct timespec ts = { 0, (rand() % (max_alive_ms * 1000) + 1) * 1000L };
+            nanosleep(&ts, NULL);
+            kill(pid, SIGKILL);
+        }
+        waitpid(pid, &status, 0);
+        if (final_run ? !(WIFEXITED(status) && WEXITSTATUS(status) == 0)
+                      : !(WIFSIGNALED(status) && WTERMSIG(status) == SIGKILL)) {
+            fprintf(stderr, "run %d: child exited unexpectedly (status %d)\n", r, status);
+            return EXIT_FAILURE;
+        }
+    }
+
+    double* times = malloc(sizeof(double) * runs);
+    for (int r = 0; r < runs; r++) times[r] = states[r].recovery_ms;
+    qsort(times, runs, sizeof(double), cmp_double);
+    printf("iterations: %d, threads per process: %d\n", iterations, g_threads);
+    printf("recovery (logger_init + drain) ms: min %.3f  p50 %.3f  p90 %.3f  p99 %.3f  max %.3f\n",
+           times[0], times[runs / 2], times[runs * 9 / 10], times[runs * 99 / 100], times[runs - 1]);
+    free(times);
+
+    long failures = verify("persisted_log.txt", states, runs);
+    printf("%s\n", failures ? "FAILED" : "PASSED");
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -1,5 +1,6 @@
 #include "../include/logger.h"
 #include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -8,6 +9,9 @@
 #define THREAD_COUNT 5
 #define MESSAGES_PER_THREAD 100
 
+static int g_msg_schema = -1;   // 结构化日志 schema id
+static logger_t* g_audit = NULL; // 独立的审计日志实例，与默认实例共享写入线程池
+
 void sleep_ms(int milliseconds) {
     struct timespec ts;
     ts.tv_sec = milliseconds / 1000;
@@ -23,6 +27,14 @@ void* writer_thread(void* arg) {
         if(!logger_write(msg)){
             printf("日志{%s}未成功写入\n",msg);
         }
+        // 同一条消息的结构化版本，落盘到 persisted_log.bin，用 tools/log_decode 查看
+        if(!logger_write_kv(g_msg_schema, (int64_t)id, (int64_t)i, "Message")){
+            printf("结构化日志{%d,%d}未成功写入\n",id,i);
+        }
+        if(i % 10 == 0){
+            snprintf(msg, sizeof(msg), "[Thread %d] checkpoint %d", id, i / 10);
+            logger_log(g_audit, msg);
+        }
         // 使用 nanosleep 代替 usleep 更标准\n  struct timespec ts = {0, 10 * 1000 * 1000}; // 10ms\n   nanosleep(&ts, NULL);
         sleep_ms(10);   // 10ms
     }
@@ -35,6 +47,31 @@ int main(void) {
         return 1;
     }
 
+    logger_config_t audit_config = {
+        .backing_file = "audit_buffer.mmap",
+        .text_path = "audit_log.txt",
+        .binary_path = "audit_log.bin",
+    };
+    g_audit = logger_open(&audit_config);
+    if (!g_audit) {
+        fprintf(stderr, "Audit logger open failed\n");
+        logger_shutdown();
+        return 1;
+    }
+
+    const log_field_def_t fields[] = {
+        {"thread", LOG_FIELD_I64},
+        {"seq",    LOG_FIELD_I64},
+        {"text",   LOG_FIELD_STR},
+    };
+    g_msg_schema = logger_register_schema("thread_msg", fields, sizeof(fields) / sizeof(fields[0]));
+    if (g_msg_schema < 0) {
+        fprintf(stderr, "Schema registration failed\n");
+        logger_close(g_audit);
+        logger_shutdown();
+        return 1;
+    }
+
     pthread_t threads[THREAD_COUNT];
     int ids[THREAD_COUNT];
     for (int i = 0; i < THREAD_COUNT; i++) {
@@ -47,7 +84,9 @@ int main(void) {
     }
     // 手动刷新一次，确保所有日志持久化
     logger_flush();
+    logger_sync(g_audit);
 
+    logger_close(g_audit);
     logger_shutdown();
 
     printf("程序结束\n");
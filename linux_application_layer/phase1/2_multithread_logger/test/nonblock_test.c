@@ -0,0 +1,155 @@
+/**
+    @file nonblock_test.c
+    @brief 非阻塞写入与空间就绪 fd 的测试
+    @details 写满缓冲区直到 logger_try_log 返回 EAGAIN，登记后等待空间 fd 可读，读取清零后确认 fd 不再可读（水平触发不空转）；
+    @details 再用 log_pending_t 连续写入一批消息，按 fd 事件补写，关闭后校验落盘文件中的消息完整且顺序不变
+    @details 用法：nonblock_test [-n 消息数]
+*/
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include "../include/logger.h"
+#include "../include/log_pending.h"
+
+#define BACKING_FILE    "nonblock_buffer.mmap"
+#define TEXT_FILE       "nonblock_log.txt"
+#define BINARY_FILE     "nonblock_log.bin"
+#define FILL_MAX_TRIES  (1 << 22)   // 写满缓冲区的最大尝试次数
+#define WAIT_MS         5000        // 等待空间就绪的最长时间
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+        fprintf(stderr, __VA_ARGS__); \
+        fputc('\n', stderr); \
+        exit(EXIT_FAILURE); \
+    } \
+} while (0)
+
+static int readable(int fd, int timeout_ms)
+{
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    int n;
+    while ((n = poll(&pfd, 1, timeout_ms)) < 0 && errno == EINTR) {}
+    return n > 0 && (pfd.revents & POLLIN);
+}
+
+// 反复写入直到缓冲区满
+static void fill_ring(logger_t* logger)
+{
+    for (int i = 0; i < FILL_MAX_TRIES; i++) {
+        if (logger_try_log(logger, "fill")) continue;
+        CHECK(errno == EAGAIN, "logger_try_log: %s", strerror(errno));
+        return;
+    }
+    CHECK(0, "ring never filled after %d writes", FILL_MAX_TRIES);
+}
+
+// 空间等待方：登记后可读，清零后保持不可读，直到再次登记
+static void test_space_waiter(logger_t* logger)
+{
+    log_space_waiter_t* waiter = logger_space_waiter_open(logger);
+    CHECK(waiter, "logger_space_waiter_open");
+    int fd = logger_space_waiter_fd(waiter);
+
+    fill_ring(logger);
+    logger_space_waiter_arm(waiter);
+    CHECK(readable(fd, WAIT_MS), "space fd not readable after the writer drained the ring");
+    eventfd_t count;
+    CHECK(eventfd_read(fd, &count) == 0, "eventfd_read: %s", strerror(errno));
+
+    // 缓冲区再次写满，但未重新登记：fd 必须保持不可读
+    fill_ring(logger);
+    CHECK(!readable(fd, 200), "space fd readable without being armed");
+
+    logger_space_waiter_arm(waiter);
+    CHECK(readable(fd, WAIT_MS), "space fd not readable after re-arming");
+    logger_space_waiter_close(waiter);
+    printf("space waiter: ok\n");
+}
+
+// 待写队列：全部消息最终按顺序写入
+static void test_pending(logger_t* logger, int count)
+{
+    log_pending_t* q = log_pending_create(logger, count);
+    CHECK(q, "log_pending_create");
+    int fd = log_pending_fd(q);
+
+    char msg[64];
+    size_t max_queued = 0;
+    for (int i = 0; i < count; i++) {
+        snprintf(msg, sizeof(msg), "pending %d", i);
+        CHECK(log_pending_log(q, msg), "log_pending_log dropped message %d", i);
+        if (log_pending_count(q) > max_queued) max_queued = log_pending_count(q);
+    }
+    CHECK(max_queued > 0, "ring never filled, increase -n");
+
+    int wakeups = 0;
+    while (log_pending_count(q) > 0) {
+        CHECK(readable(fd, WAIT_MS), "space fd not readable with %zu messages queued", log_pending_count(q));
+        log_pending_flush(q);
+        wakeups++;
+    }
+    CHECK(log_pending_dropped(q) == 0, "%zu messages dropped", log_pending_dropped(q));
+    CHECK(!readable(fd, 0), "space fd readable with an empty queue");
+    log_pending_destroy(q);
+    printf("pending queue: %d messages, up to %zu queued, %d wakeups\n", count, max_queued, wakeups);
+}
+
+// 校验落盘文件中 "pending i" 按 0..count-1 的顺序各出现一次
+static void verify_order(int count)
+{
+    FILE* fp = fopen(TEXT_FILE, "r");
+    CHECK(fp, "fopen %s: %s", TEXT_FILE, strerror(errno));
+    char line[512];
+    int expect = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        const char* p = strstr(line, "pending ");
+        if (!p) continue;
+        int n = atoi(p + strlen("pending "));
+        CHECK(n == expect, "expected pending %d, found pending %d", expect, n);
+        expect++;
+    }
+    fclose(fp);
+    CHECK(expect == count, "only %d of %d pending messages persisted", expect, count);
+    printf("order: ok\n");
+}
+
+int main(int argc, char* argv[])
+{
+    int count = 20000;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        if (opt == 'n') count = atoi(optarg);
+        else {
+            fprintf(stderr, "用法: %s [-n 消息数]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    unlink(BACKING_FILE);
+    unlink(TEXT_FILE);
+    unlink(BINARY_FILE);
+    logger_config_t config = {
+        .backing_file = BACKING_FILE,
+        .text_path = TEXT_FILE,
+        .binary_path = BINARY_FILE,
+    };
+    logger_t* logger = logger_open(&config);
+    CHECK(logger, "logger_open");
+
+    test_space_waiter(logger);
+    test_pending(logger, count);
+    logger_close(logger);
+    verify_order(count);
+
+    unlink(BACKING_FILE);
+    unlink(TEXT_FILE);
+    unlink(BINARY_FILE);
+    printf("PASS\n");
+    return EXIT_SUCCESS;
+}